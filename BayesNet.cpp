@@ -1,6 +1,8 @@
 #include <cmath>
 #include <sstream>
 #include <set>
+#include <random>
+#include <algorithm>
 
 #include "BayesNet.hpp"
 
@@ -10,23 +12,46 @@ void CPT0::buildTable(const vector<Instance*>& instances) {
     vector<int> YOccurance;
     YOccurance.resize(rangeY);
     
+    int total = 0;
     for (int i = 0; i < instances.size(); ++i) {
         Instance* inst = instances[i];
         int valY = (int)round(inst->classLabel);
-        YOccurance[valY]++;
+        YOccurance[valY] += inst->weight;
+        total += inst->weight;
     }
     
-    int total = (int)instances.size();
     for (int valY = 0; valY < rangeY; ++valY) {
         table[valY] = (YOccurance[valY] + 1.0) / (total + rangeY);
     }
 }
 
+void CPT0::buildTable(const CountTensor& counts) {
+    int rangeY = (int)table.size();
+    for (int valY = 0; valY < rangeY; ++valY)
+        table[valY] = (counts.getClassCount(valY) + 1.0) / (counts.getTotal() + rangeY);
+}
+
 double CPT0::computeCondProb(const Instance* instance) const {
     int valSelf = (int)round(instance->classLabel);
     return table[valSelf];
 }
 
+long long CPT0::getTableSize() const {
+    return table.size();
+}
+
+void CPT0::exportLogTable(vector<double>& logTable) const {
+    logTable.resize(table.size());
+    for (int i = 0; i < table.size(); ++i)
+        logTable[i] = log(table[i]);
+}
+
+double CPT0::computeLogRatioBound() const {
+    double maxLogProb = log(*max_element(table.begin(), table.end()));
+    double minLogProb = log(*min_element(table.begin(), table.end()));
+    return maxLogProb - minLogProb;
+}
+
 string CPT0::toString() const {
     stringstream ss;
     ss << "CPT of attribute " << self << endl;
@@ -54,8 +79,8 @@ void CPT1::buildTable(const vector<Instance*>& instances) {
         Instance* inst = instances[i];
         int valX = (int)round(inst->featureVector[self]);
         int valY = (int)round(inst->classLabel);
-        YOccurance[valY]++;
-        XYOccurance[valX][valY]++;
+        YOccurance[valY] += inst->weight;
+        XYOccurance[valX][valY] += inst->weight;
     }
     
     for (int valX = 0; valX < rangeX; ++valX)
@@ -63,12 +88,43 @@ void CPT1::buildTable(const vector<Instance*>& instances) {
             table[valX][valY] = (XYOccurance[valX][valY] + 1.0) / (YOccurance[valY] + rangeX);
 }
 
+void CPT1::buildTable(const CountTensor& counts) {
+    int rangeX = (int)table.size();
+    int rangeY = (int)table[0].size();
+    
+    for (int valX = 0; valX < rangeX; ++valX)
+        for (int valY = 0; valY < rangeY; ++valY)
+            table[valX][valY] = (counts.getFeatureCount(self, valX, valY) + 1.0) / (counts.getClassCount(valY) + rangeX);
+}
+
 double CPT1::computeCondProb(const Instance* instance) const {
     int valSelf = (int)round(instance->featureVector[self]);
     int valParent = (int)round(instance->classLabel);
     return table[valSelf][valParent];
 }
 
+long long CPT1::getTableSize() const {
+    return (long long)table.size() * table[0].size();
+}
+
+void CPT1::exportLogTable(vector<double>& logTable) const {
+    int rangeY = (int)table[0].size();
+    logTable.resize(getTableSize());
+    for (int i = 0; i < table.size(); ++i)
+        for (int j = 0; j < rangeY; ++j)
+            logTable[i * rangeY + j] = log(table[i][j]);
+}
+
+double CPT1::computeLogRatioBound() const {
+    double bound = 0.0;
+    for (int i = 0; i < table.size(); ++i) {
+        double maxLogProb = log(*max_element(table[i].begin(), table[i].end()));
+        double minLogProb = log(*min_element(table[i].begin(), table[i].end()));
+        bound = max(bound, maxLogProb - minLogProb);
+    }
+    return bound;
+}
+
 string CPT1::toString() const {
     stringstream ss;
     ss << "CPT of attribute " << self << endl;
@@ -104,8 +160,8 @@ void CPT2::buildTable(const vector<Instance*>& instances) {
         int valX = (int)round(inst->featureVector[self]);
         int valZ = (int)round(inst->featureVector[parents[0]]);
         int valY = (int)round(inst->classLabel);
-        ZYOccurance[valZ][valY]++;
-        XZYOccurance[valX][valZ][valY]++;
+        ZYOccurance[valZ][valY] += inst->weight;
+        XZYOccurance[valX][valZ][valY] += inst->weight;
     }
     
     for (int valX = 0; valX < rangeX; ++valX)
@@ -114,6 +170,23 @@ void CPT2::buildTable(const vector<Instance*>& instances) {
                 table[valX][valZ][valY] = (XZYOccurance[valX][valZ][valY] + 1.0) / (ZYOccurance[valZ][valY] + rangeX);
 }
 
+void CPT2::buildTable(const CountTensor& counts) {
+    int rangeX = (int)table.size();
+    int rangeZ = (int)table[0].size();
+    int rangeY = (int)table[0][0].size();
+    
+    vector<int> buffer(rangeY);
+    for (int valX = 0; valX < rangeX; ++valX) {
+        for (int valZ = 0; valZ < rangeZ; ++valZ) {
+            const int* XZYOccurance = self < parents[0] ?
+                counts.getPairCounts(self, parents[0], valX, valZ, &buffer[0]) :
+                counts.getPairCounts(parents[0], self, valZ, valX, &buffer[0]);
+            for (int valY = 0; valY < rangeY; ++valY)
+                table[valX][valZ][valY] = (XZYOccurance[valY] + 1.0) / (counts.getFeatureCount(parents[0], valZ, valY) + rangeX);
+        }
+    }
+}
+
 double CPT2::computeCondProb(const Instance* instance) const {
     int valSelf = (int)round(instance->featureVector[self]);
     int valParent0 = (int)round(instance->featureVector[parents[0]]);
@@ -121,6 +194,32 @@ double CPT2::computeCondProb(const Instance* instance) const {
     return table[valSelf][valParent0][valParent1];
 }
 
+long long CPT2::getTableSize() const {
+    return (long long)table.size() * table[0].size() * table[0][0].size();
+}
+
+void CPT2::exportLogTable(vector<double>& logTable) const {
+    int rangeZ = (int)table[0].size();
+    int rangeY = (int)table[0][0].size();
+    logTable.resize(getTableSize());
+    for (int i = 0; i < table.size(); ++i)
+        for (int j = 0; j < rangeZ; ++j)
+            for (int k = 0; k < rangeY; ++k)
+                logTable[((long long)i * rangeZ + j) * rangeY + k] = log(table[i][j][k]);
+}
+
+double CPT2::computeLogRatioBound() const {
+    double bound = 0.0;
+    for (int i = 0; i < table.size(); ++i) {
+        for (int j = 0; j < table[i].size(); ++j) {
+            double maxLogProb = log(*max_element(table[i][j].begin(), table[i][j].end()));
+            double minLogProb = log(*min_element(table[i][j].begin(), table[i][j].end()));
+            bound = max(bound, maxLogProb - minLogProb);
+        }
+    }
+    return bound;
+}
+
 string CPT2::toString() const {
     stringstream ss;
     ss << "CPT of attribute " << self << endl;
@@ -136,73 +235,191 @@ string CPT2::toString() const {
     return ss.str();
 }
 
-BayesNet::BayesNet(const DatasetMetadata* metadata, const vector<Instance*>& instances, bool treeAugmented) :
-    metadata(metadata), instances(instances), treeAugmented(treeAugmented) {
-    if (treeAugmented) {
+void SparseCPT2::buildTable(const vector<Instance*>& instances) {
+    for (int i = 0; i < instances.size(); ++i) {
+        Instance* inst = instances[i];
+        int valX = (int)round(inst->featureVector[self]);
+        int valZ = (int)round(inst->featureVector[parents[0]]);
+        int valY = (int)round(inst->classLabel);
+        ZYOccurance[valZ * rangeY + valY] += inst->weight;
+        XZYOccurance.increment(((long long)valX * rangeZ + valZ) * rangeY + valY, inst->weight);
+    }
+}
+
+// A CPT is sparse exactly when the count tensor stores its (self, parent) pair sparsely, so only
+// the observed cells of that pair are copied.
+void SparseCPT2::buildTable(const CountTensor& counts) {
+    for (int valZ = 0; valZ < rangeZ; ++valZ)
+        for (int valY = 0; valY < rangeY; ++valY)
+            ZYOccurance[valZ * rangeY + valY] = counts.getFeatureCount(parents[0], valZ, valY);
+    
+    bool selfFirst = self < parents[0];
+    const SparseTable* pairCounts = selfFirst ?
+        counts.getSparsePairCounts(self, parents[0]) : counts.getSparsePairCounts(parents[0], self);
+    int rangeSecond = selfFirst ? rangeZ : rangeX;
+    
+    XZYOccurance = SparseTable();
+    for (int slot = 0; slot < pairCounts->getCapacity(); ++slot) {
+        if (pairCounts->isOccupied(slot)) {
+            long long key = pairCounts->getKey(slot);
+            int valY = (int)(key % rangeY);
+            int valFirst = (int)(key / rangeY / rangeSecond);
+            int valSecond = (int)(key / rangeY % rangeSecond);
+            int valX = selfFirst ? valFirst : valSecond;
+            int valZ = selfFirst ? valSecond : valFirst;
+            XZYOccurance.increment(((long long)valX * rangeZ + valZ) * rangeY + valY, pairCounts->getValue(slot));
+        }
+    }
+}
+
+double SparseCPT2::computeCondProb(const Instance* instance) const {
+    int valSelf = (int)round(instance->featureVector[self]);
+    int valParent0 = (int)round(instance->featureVector[parents[0]]);
+    int valParent1 = (int)round(instance->classLabel);
+    int count = XZYOccurance.get(((long long)valSelf * rangeZ + valParent0) * rangeY + valParent1);
+    return (count + 1.0) / (ZYOccurance[valParent0 * rangeY + valParent1] + rangeX);
+}
+
+long long SparseCPT2::getTableSize() const {
+    return (long long)rangeX * rangeZ * rangeY;
+}
+
+void SparseCPT2::exportLogTable(vector<double>& logTable) const {
+    logTable.resize(getTableSize());
+    for (long long cell = 0; cell < logTable.size(); ++cell) {
+        int count = XZYOccurance.get(cell);
+        logTable[cell] = log((count + 1.0) / (ZYOccurance[cell % ((long long)rangeZ * rangeY)] + rangeX));
+    }
+}
+
+// No cell count exceeds its parent count, so Pr <= (N(z, y) + 1) / (N(z, y) + rangeX), and an
+// unseen cell gives the minimum 1 / (N(z, y) + rangeX).
+double SparseCPT2::computeLogRatioBound() const {
+    double bound = 0.0;
+    for (int j = 0; j < rangeZ; ++j) {
+        double maxLogProb = -INFINITY;
+        double minLogProb = 0.0;
+        for (int k = 0; k < rangeY; ++k) {
+            double count = ZYOccurance[j * rangeY + k];
+            maxLogProb = max(maxLogProb, log((count + 1.0) / (count + rangeX)));
+            minLogProb = min(minLogProb, -log(count + rangeX));
+        }
+        bound = max(bound, maxLogProb - minLogProb);
+    }
+    return bound;
+}
+
+string SparseCPT2::toString() const {
+    stringstream ss;
+    ss << "CPT of attribute " << self << endl;
+    
+    ss.setf(ios::fixed, ios::floatfield);
+    ss.precision(PRECISION);
+    for (int k = 0; k < rangeY; ++k)
+        for (int j = 0; j < rangeZ; ++j)
+            for (int i = 0; i < rangeX; ++i) {
+                int count = XZYOccurance.get(((long long)i * rangeZ + j) * rangeY + k);
+                ss << "Pr(" << self << " = " << i << " | " << parents[0] << " = " << j << ", " <<
+                    parents[1] << " = " << k << ") = " << (count + 1.0) / (ZYOccurance[j * rangeY + k] + rangeX) << endl;
+            }
+    
+    return ss.str();
+}
+
+BayesNet::BayesNet(const DatasetMetadata* metadata, const vector<Instance*>& instances, const TrainingOptions& options,
+    CountTensor* sharedCounts) :
+    metadata(metadata), instances(instances), options(options), pairwiseCounts(sharedCounts), ownsCounts(!sharedCounts),
+    tiled(false), sampled(false), numOfSampledInstances((int)instances.size()) {
+    if (options.modelType == TREE_AUGMENTED && !options.online && ownsCounts) {
+        sampled = options.sampleSize > 0 && options.sampleSize < instances.size();
+        tiled = !sampled && isOverBudget();
+    }
+    if (ownsCounts && (options.modelType != NAIVE_BAYES || options.isPruning() || options.earlyExit || options.online))
+        pairwiseCounts = new CountTensor(metadata, instances, options.modelType != NAIVE_BAYES && !tiled && !sampled);
+    createFeatureSelection();
+    if (options.modelType == TREE_AUGMENTED) {
         createMutualInfoTable();
         createMaximalSpanningTree();
     }
     createBayesNet();
-    createProbabilityTables();
+    if (options.modelType == AVERAGED_ONE_DEPENDENCE) {
+        createAveragedEstimators();
+    } else {
+        createProbabilityTables();
+        if (options.earlyExit)
+            createScoringPlan();
+        if (pairwiseCounts && !options.online) {
+            if (ownsCounts)
+                delete pairwiseCounts;
+            pairwiseCounts = 0;
+        }
+    }
+    if (options.online && options.modelType == TREE_AUGMENTED)
+        pairwiseCounts->trackMutualInfo();
 }
 
-double BayesNet::computeMutualInfo(int featureIdxI, int featureIdxJ) const {
-    Feature* Y = metadata->classVariable;
-    Feature* Xi = metadata->featureList[featureIdxI];
-    Feature* Xj = metadata->featureList[featureIdxJ];
+void BayesNet::createFeatureSelection() {
+    int numOfFeatures = metadata->numOfFeatures;
     
-    int rangeY = Y->getRange();
-    int rangeXi = Xi->getRange();
-    int rangeXj = Xj->getRange();
+    featureMask.assign(numOfFeatures, true);
+    if (options.isPruning() || options.earlyExit) {
+        classMutualInfo.resize(numOfFeatures);
+        for (int i = 0; i < numOfFeatures; ++i)
+            classMutualInfo[i] = pairwiseCounts->computeClassMutualInfo(i);
+    }
     
-    vector<int> YOccurance;
-    YOccurance.resize(rangeY);
-    vector<vector<int> > YXiOccurance;
-    YXiOccurance.resize(rangeY);
-    for (int valY = 0; valY < rangeY; ++valY)
-        YXiOccurance[valY].resize(rangeXi);
-    vector<vector<int> > YXjOccurance;
-    YXjOccurance.resize(rangeY);
-    for (int valY = 0; valY < rangeY; ++valY)
-        YXjOccurance[valY].resize(rangeXj);
-    vector<vector<vector<int> > > YXiXjOccurance;
-    YXiXjOccurance.resize(rangeY);
-    for (int valY = 0; valY < rangeY; ++valY) {
-        YXiXjOccurance[valY].resize(rangeXi);
-        for (int valXi = 0; valXi < rangeXi; ++valXi)
-            YXiXjOccurance[valY][valXi].resize(rangeXj);
+    if (options.isPruning()) {
+        vector<int> ranking(numOfFeatures);
+        for (int i = 0; i < numOfFeatures; ++i)
+            ranking[i] = i;
+        stable_sort(ranking.begin(), ranking.end(), [this](int a, int b) {
+            return classMutualInfo[a] > classMutualInfo[b];
+        });
+        
+        int numOfKept = numOfFeatures;
+        if (options.maxFeatures > 0 && options.maxFeatures < numOfKept)
+            numOfKept = options.maxFeatures;
+        for (int k = 0; k < numOfFeatures; ++k) {
+            int i = ranking[k];
+            featureMask[i] = k == 0 || (k < numOfKept && classMutualInfo[i] >= options.minClassMutualInfo);
+        }
     }
     
-    for (int i = 0; i < instances.size(); ++i) {
-        Instance* inst = instances[i];
-        int valY = (int)round(inst->classLabel);
-        int valXi = (int)round(inst->featureVector[featureIdxI]);
-        int valXj = (int)round(inst->featureVector[featureIdxJ]);
-        YOccurance[valY]++;
-        YXiOccurance[valY][valXi]++;
-        YXjOccurance[valY][valXj]++;
-        YXiXjOccurance[valY][valXi][valXj]++;
+    for (int i = 0; i < numOfFeatures; ++i)
+        if (featureMask[i])
+            activeFeatures.push_back(i);
+}
+
+string BayesNet::getFeatureSelection() const {
+    stringstream ss;
+    ss << "<Feature Selection>" << endl;
+    
+    if (options.isPruning()) {
+        ss.setf(ios::fixed, ios::floatfield);
+        ss.precision(PRECISION);
+        for (int i = 0; i < metadata->numOfFeatures; ++i)
+            ss << metadata->featureList[i]->getName() << DELIMITER << classMutualInfo[i] << DELIMITER <<
+                (featureMask[i] ? "kept" : "pruned") << endl;
+    } else {
+        ss << "Not applicable" << endl;
     }
     
-    int total = (int)instances.size();
-    double mutualInfo = 0.0;
-    for (int valY = 0; valY < rangeY; ++valY) {
-        for (int valXi = 0; valXi < rangeXi; ++valXi) {
-            for (int valXj = 0; valXj < rangeXj; ++valXj) {
-                double pXiXjY = (YXiXjOccurance[valY][valXi][valXj] + 1.0) /
-                    (total + rangeXi * rangeXj * rangeY);
-                double pXiXj_Y = (YXiXjOccurance[valY][valXi][valXj] + 1.0) /
-                    (YOccurance[valY] + rangeXi * rangeXj);
-                double pXi_Y = (YXiOccurance[valY][valXi] + 1.0) /
-                    (YOccurance[valY] + rangeXi);
-                double pXj_Y = (YXjOccurance[valY][valXj] + 1.0) /
-                    (YOccurance[valY] + rangeXj);
-                mutualInfo += pXiXjY * log2(pXiXj_Y / (pXi_Y * pXj_Y));
-            }
+    return ss.str();
+}
+
+bool BayesNet::isOverBudget() const {
+    if (options.memoryBudget == 0)
+        return false;
+    
+    size_t size = CountTensor::estimateFixedSize(metadata);
+    for (int i = 0; i < metadata->numOfFeatures; ++i) {
+        for (int j = i + 1; j < metadata->numOfFeatures; ++j) {
+            size += CountTensor::estimatePairSize(metadata, i, j, (int)instances.size());
+            if (size > options.memoryBudget)
+                return true;
         }
     }
-    
-    return mutualInfo;
+    return false;
 }
 
 void BayesNet::createMutualInfoTable() {
@@ -210,24 +427,194 @@ void BayesNet::createMutualInfoTable() {
     
     mutualInfoTable.resize(numOfFeatures);
     for (int i = 0; i < numOfFeatures; ++i)
-        mutualInfoTable[i].resize(numOfFeatures);
+        mutualInfoTable[i].assign(numOfFeatures, -1.0);
     
+    if (sampled) {
+        createSampledMutualInfoTable();
+        return;
+    }
+    if (!tiled) {
+        for (int i = 0; i < numOfFeatures; ++i) {
+            for (int j = i + 1; j < numOfFeatures; ++j) {
+                double mutualInfo = featureMask[i] && featureMask[j] ? pairwiseCounts->computeMutualInfo(i, j) : -1.0;
+                mutualInfoTable[i][j] = mutualInfo;
+                mutualInfoTable[j][i] = mutualInfo;
+            }
+        }
+        return;
+    }
     
+    // Greedily pack whole rows of pairs into tiles under what the budget leaves after the fixed
+    // size of a tile; a row that does not fit on its own is split into column ranges instead.
+    int numOfInstances = (int)instances.size();
+    size_t fixedSize = CountTensor::estimateFixedSize(metadata);
+    size_t tileBudget = options.memoryBudget > fixedSize ? options.memoryBudget - fixedSize : 0;
+    int rowBegin = 0;
+    size_t tileSize = 0;
     for (int i = 0; i < numOfFeatures; ++i) {
-        mutualInfoTable[i][i] = -1.0;
-        for (int j = i + 1; j < numOfFeatures; ++j) {
-            double mutualInfo = computeMutualInfo(i, j);
-            mutualInfoTable[i][j] = mutualInfo;
-            mutualInfoTable[j][i] = mutualInfo;
+        size_t rowSize = 0;
+        for (int j = i + 1; j < numOfFeatures; ++j)
+            rowSize += CountTensor::estimatePairSize(metadata, i, j, numOfInstances);
+        
+        if (i > rowBegin && tileSize + rowSize > tileBudget) {
+            createMutualInfoTile(rowBegin, i, 0, numOfFeatures);
+            rowBegin = i;
+            tileSize = 0;
+        }
+        
+        if (rowSize > tileBudget) {
+            int colBegin = i + 1;
+            size_t colSize = 0;
+            for (int j = i + 1; j < numOfFeatures; ++j) {
+                size_t pairSize = CountTensor::estimatePairSize(metadata, i, j, numOfInstances);
+                if (j > colBegin && colSize + pairSize > tileBudget) {
+                    createMutualInfoTile(i, i + 1, colBegin, j);
+                    colBegin = j;
+                    colSize = 0;
+                }
+                colSize += pairSize;
+            }
+            createMutualInfoTile(i, i + 1, colBegin, numOfFeatures);
+            rowBegin = i + 1;
+        } else {
+            tileSize += rowSize;
         }
     }
+    if (rowBegin < numOfFeatures)
+        createMutualInfoTile(rowBegin, numOfFeatures, 0, numOfFeatures);
+}
+
+void BayesNet::createMutualInfoTile(int rowBegin, int rowEnd, int colBegin, int colEnd) {
+    bool isActive = false;
+    for (int i = rowBegin; i < rowEnd && !isActive; ++i)
+        for (int j = max(i + 1, colBegin); j < colEnd && !isActive; ++j)
+            isActive = featureMask[i] && featureMask[j];
+    if (!isActive)
+        return;
+    
+    CountTensor tile(metadata, instances, rowBegin, rowEnd, colBegin, colEnd);
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        for (int j = max(i + 1, colBegin); j < colEnd; ++j) {
+            if (featureMask[i] && featureMask[j]) {
+                double mutualInfo = tile.computeMutualInfo(i, j);
+                mutualInfoTable[i][j] = mutualInfo;
+                mutualInfoTable[j][i] = mutualInfo;
+            }
+        }
+    }
+}
+
+// Progressive sampling: the table is estimated on a shuffled prefix of the instances that doubles
+// until every pair is resolved, i.e. its confidence interval (CMI_CONFIDENCE_Z deviations plus
+// the Miller-Madow bias) cannot change the spanning tree, or the prefix covers all instances.
+// Pairs resolved by the latest check keep their estimate instead of being re-evaluated; the
+// counts themselves always cover every pair. Once the prefix covers all instances, every pair
+// is recomputed, so the table is then exact.
+void BayesNet::createSampledMutualInfoTable() {
+    int numOfFeatures = metadata->numOfFeatures;
+    int rangeY = metadata->classVariable->getRange();
+    
+    vector<Instance*> shuffled(instances.begin(), instances.end());
+    shuffle(shuffled.begin(), shuffled.end(), default_random_engine());
+    
+    vector<vector<double> > radius(numOfFeatures, vector<double>(numOfFeatures, 0.0));
+    vector<vector<bool> > resolved(numOfFeatures, vector<bool>(numOfFeatures, false));
+    int numOfSamples = options.sampleSize;
+    CountTensor counts(metadata, vector<Instance*>(shuffled.begin(), shuffled.begin() + numOfSamples));
+    while (true) {
+        bool isExact = numOfSamples == shuffled.size();
+        for (int a = 0; a < activeFeatures.size(); ++a) {
+            for (int b = a + 1; b < activeFeatures.size(); ++b) {
+                int i = activeFeatures[a];
+                int j = activeFeatures[b];
+                if (resolved[i][j] && !isExact)
+                    continue;
+                int rangeXi = metadata->featureList[i]->getRange();
+                int rangeXj = metadata->featureList[j]->getRange();
+                double bias = (rangeXi - 1.0) * (rangeXj - 1.0) * rangeY / (2.0 * counts.getTotal() * log(2.0));
+                mutualInfoTable[i][j] = mutualInfoTable[j][i] = counts.computeMutualInfo(i, j);
+                radius[i][j] = radius[j][i] = CMI_CONFIDENCE_Z * counts.computeMutualInfoDeviation(i, j) / sqrt((double)counts.getTotal()) + bias;
+            }
+        }
+        if (isExact)
+            break;
+        
+        maximalSpanningTree.clear();
+        createMaximalSpanningTree();
+        if (isSeparated(radius, resolved))
+            break;
+        
+        int nextSize = (int)min((size_t)numOfSamples * 2, shuffled.size());
+        counts.update(vector<Instance*>(shuffled.begin() + numOfSamples, shuffled.begin() + nextSize));
+        numOfSamples = nextSize;
+    }
+    maximalSpanningTree.clear();
+    numOfSampledInstances = numOfSamples;
+}
+
+// Cycle property with intervals: a non-tree pair is resolved when its upper bound lies below the
+// lower bound of every tree edge on the path between its endpoints, and a tree edge when the
+// upper bound of every non-tree pair whose path runs through it lies below its lower bound.
+// Sets resolved to the outcome of this check and returns whether all pairs are resolved.
+bool BayesNet::isSeparated(const vector<vector<double> >& radius, vector<vector<bool> >& resolved) const {
+    int numOfFeatures = metadata->numOfFeatures;
+    
+    vector<vector<int> > adjacency(numOfFeatures);
+    for (int i = 0; i < maximalSpanningTree.size(); ++i) {
+        adjacency[maximalSpanningTree[i].first].push_back(maximalSpanningTree[i].second);
+        adjacency[maximalSpanningTree[i].second].push_back(maximalSpanningTree[i].first);
+    }
+    
+    vector<vector<bool> > unresolved(numOfFeatures, vector<bool>(numOfFeatures, false));
+    vector<double> pathMin(numOfFeatures);
+    vector<int> parent(numOfFeatures);
+    vector<int> stack;
+    bool isSeparated = true;
+    for (int a = 0; a < activeFeatures.size(); ++a) {
+        int root = activeFeatures[a];
+        pathMin.assign(numOfFeatures, -INFINITY);
+        pathMin[root] = INFINITY;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            for (int k = 0; k < adjacency[u].size(); ++k) {
+                int v = adjacency[u][k];
+                if (pathMin[v] == -INFINITY) {
+                    pathMin[v] = min(pathMin[u], mutualInfoTable[u][v] - radius[u][v]);
+                    parent[v] = u;
+                    stack.push_back(v);
+                }
+            }
+        }
+        for (int b = a + 1; b < activeFeatures.size(); ++b) {
+            int j = activeFeatures[b];
+            bool isTreeEdge = find(adjacency[root].begin(), adjacency[root].end(), j) != adjacency[root].end();
+            double upperBound = mutualInfoTable[root][j] + radius[root][j];
+            if (!isTreeEdge && upperBound >= pathMin[j]) {
+                unresolved[root][j] = unresolved[j][root] = true;
+                for (int v = j; v != root; v = parent[v]) {
+                    int u = parent[v];
+                    if (mutualInfoTable[u][v] - radius[u][v] <= upperBound)
+                        unresolved[u][v] = unresolved[v][u] = true;
+                }
+                isSeparated = false;
+            }
+        }
+    }
+    
+    for (int a = 0; a < activeFeatures.size(); ++a)
+        for (int b = 0; b < activeFeatures.size(); ++b)
+            resolved[activeFeatures[a]][activeFeatures[b]] = !unresolved[activeFeatures[a]][activeFeatures[b]];
+    
+    return isSeparated;
 }
 
 string BayesNet::getMutualInfoTable() const {
     stringstream ss;
     ss << "<Conditional Mutual Information Table>" << endl;
     
-    if (treeAugmented) {
+    if (options.modelType == TREE_AUGMENTED) {
         ss.setf(ios::fixed, ios::floatfield);
         ss.precision(PRECISION);
         for (int i = 0; i < mutualInfoTable.size(); ++i) {
@@ -245,13 +632,13 @@ string BayesNet::getMutualInfoTable() const {
 }
 
 void BayesNet::createMaximalSpanningTree() {
-    int numOfFeatures = metadata->numOfFeatures;
+    int numOfFeatures = (int)activeFeatures.size();
 
     set<int> nodesInTree;
     set<int> nodesNotInTree;
-    nodesInTree.insert(0);
+    nodesInTree.insert(activeFeatures[0]);
     for (int i = 1; i < numOfFeatures; ++i)
-        nodesNotInTree.insert(i);
+        nodesNotInTree.insert(activeFeatures[i]);
     
     while (nodesInTree.size() < numOfFeatures) {
         double maxWeight = -1.0;
@@ -274,11 +661,48 @@ void BayesNet::createMaximalSpanningTree() {
     }
 }
 
+// Cycle property: the tree stays maximal as long as no non-tree edge outweighs the lightest
+// edge on the tree path between its endpoints.
+bool BayesNet::isMaximalSpanningTree() const {
+    int numOfFeatures = metadata->numOfFeatures;
+    
+    vector<vector<int> > adjacency(numOfFeatures);
+    for (int i = 0; i < maximalSpanningTree.size(); ++i) {
+        adjacency[maximalSpanningTree[i].first].push_back(maximalSpanningTree[i].second);
+        adjacency[maximalSpanningTree[i].second].push_back(maximalSpanningTree[i].first);
+    }
+    
+    vector<double> pathMin(numOfFeatures);
+    vector<int> stack;
+    for (int a = 0; a < activeFeatures.size(); ++a) {
+        int root = activeFeatures[a];
+        pathMin.assign(numOfFeatures, -INFINITY);
+        pathMin[root] = INFINITY;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            int u = stack.back();
+            stack.pop_back();
+            for (int k = 0; k < adjacency[u].size(); ++k) {
+                int v = adjacency[u][k];
+                if (pathMin[v] == -INFINITY) {
+                    pathMin[v] = min(pathMin[u], mutualInfoTable[u][v]);
+                    stack.push_back(v);
+                }
+            }
+        }
+        for (int b = a + 1; b < activeFeatures.size(); ++b)
+            if (mutualInfoTable[root][activeFeatures[b]] > pathMin[activeFeatures[b]])
+                return false;
+    }
+    
+    return true;
+}
+
 string BayesNet::getMaximalSpanningTree() const {
     stringstream ss;
     ss << "<Maximal Spanning Tree>" << endl;
     
-    if (treeAugmented) {
+    if (options.modelType == TREE_AUGMENTED) {
         ss << "{";
         for (int i = 0; i < maximalSpanningTree.size(); ++i) {
             if (i != 0) ss << ", ";
@@ -302,8 +726,8 @@ void BayesNet::createBayesNet() {
         bayesNet[edge.second].push_back(edge.first);
     }
     
-    for (int i = 0; i < numOfFeatures; ++i)
-        bayesNet[i].push_back(numOfFeatures);
+    for (int i = 0; i < activeFeatures.size(); ++i)
+        bayesNet[activeFeatures[i]].push_back(numOfFeatures);
 }
 
 string BayesNet::getBayesNet() const {
@@ -311,6 +735,8 @@ string BayesNet::getBayesNet() const {
     ss << "<Bayesian Network Structure>" << endl;
     
     for (int i = 0; i < bayesNet.size(); ++i) {
+        if (!featureMask[i])
+            continue;
         ss << metadata->featureList[i]->getName();
         for (int j = 0; j < bayesNet[i].size(); ++j) {
             ss << DELIMITER;
@@ -326,7 +752,7 @@ string BayesNet::getBayesNet() const {
     return ss.str();
 }
 
-CPT* BayesNet::computeCPT(int self, const vector<int>& parents) const {
+CPT* BayesNet::computeCPT(int self, const vector<int>& parents, bool fromCounts) const {
     CPT* cpt = 0;
     switch (parents.size()) {
         case 0:
@@ -336,12 +762,21 @@ CPT* BayesNet::computeCPT(int self, const vector<int>& parents) const {
             cpt = new CPT1(metadata, self, parents);
             break;
         case 2:
-            cpt = new CPT2(metadata, self, parents);
+            if ((long long)metadata->featureList[self]->getRange() * metadata->featureList[parents[0]]->getRange() *
+                metadata->classVariable->getRange() > SPARSE_TABLE_THRESHOLD)
+                cpt = new SparseCPT2(metadata, self, parents);
+            else
+                cpt = new CPT2(metadata, self, parents);
             break;
         default:
             break;
     }
-    if (cpt) cpt->buildTable(instances);
+    if (cpt) {
+        if (fromCounts)
+            cpt->buildTable(*pairwiseCounts);
+        else
+            cpt->buildTable(instances);
+    }
     return cpt;
 }
 
@@ -351,23 +786,150 @@ void BayesNet::createProbabilityTables() {
     probabilityTables.resize(numOfFeatures + 1);
     
     for (int i = 0; i < numOfFeatures; ++i)
-        probabilityTables[i] = computeCPT(i, bayesNet[i]);
-    probabilityTables[numOfFeatures] = computeCPT(numOfFeatures, vector<int>());
+        probabilityTables[i] = featureMask[i] ? computeCPT(i, bayesNet[i], !ownsCounts) : 0;
+    probabilityTables[numOfFeatures] = computeCPT(numOfFeatures, vector<int>(), !ownsCounts);
 }
 
 string BayesNet::getProbabilityTables() const {
     stringstream ss;
     ss << "<Conditional Probability Tables>" << endl;
     
-    for (int i = 0; i < probabilityTables.size(); ++i)
-        ss << probabilityTables[i]->toString();
+    if (options.modelType != AVERAGED_ONE_DEPENDENCE) {
+        for (int i = 0; i < probabilityTables.size(); ++i)
+            if (probabilityTables[i])
+                ss << probabilityTables[i]->toString();
+    } else {
+        ss << "Not applicable" << endl;
+    }
+    
+    return ss.str();
+}
+
+void BayesNet::createAveragedEstimators() {
+    int maxRange = 0;
+    for (int i = 0; i < metadata->numOfFeatures; ++i)
+        maxRange = max(maxRange, metadata->featureList[i]->getRange());
+    
+    logCache.resize(min(pairwiseCounts->getTotal() + maxRange + 1, LOG_CACHE_SIZE));
+    for (int i = 1; i < logCache.size(); ++i)
+        logCache[i] = log((double)i);
+}
+
+// Features are scored in decreasing order of I(X;Y); scoringBounds[k] is the most the features
+// from position k onwards can still move the log-ratio between any two classes.
+void BayesNet::createScoringPlan() {
+    scoringOrder = activeFeatures;
+    stable_sort(scoringOrder.begin(), scoringOrder.end(), [this](int a, int b) {
+        return classMutualInfo[a] > classMutualInfo[b];
+    });
+    
+    scoringBounds.assign(scoringOrder.size() + 1, 0.0);
+    for (int k = (int)scoringOrder.size() - 1; k >= 0; --k)
+        scoringBounds[k] = scoringBounds[k + 1] + probabilityTables[scoringOrder[k]]->computeLogRatioBound();
+    
+    scoringTables.assign(probabilityTables.size(), vector<double>());
+    probabilityTables.back()->exportLogTable(scoringTables.back());
+    for (int k = 0; k < scoringOrder.size(); ++k) {
+        int featureIdx = scoringOrder[k];
+        if (probabilityTables[featureIdx]->getTableSize() <= SPARSE_TABLE_THRESHOLD)
+            probabilityTables[featureIdx]->exportLogTable(scoringTables[featureIdx]);
+    }
+}
+
+string BayesNet::getScoringPlan() const {
+    stringstream ss;
+    ss << "<Scoring Plan>" << endl;
+    
+    if (options.earlyExit && options.modelType != AVERAGED_ONE_DEPENDENCE) {
+        ss.setf(ios::fixed, ios::floatfield);
+        ss.precision(PRECISION);
+        for (int k = 0; k < scoringOrder.size(); ++k)
+            ss << metadata->featureList[scoringOrder[k]]->getName() << DELIMITER << scoringBounds[k] << endl;
+    } else {
+        ss << "Not applicable" << endl;
+    }
     
     return ss.str();
 }
 
+// Only the CMI entries are refreshed from the running sums of the count tensor; the spanning
+// tree is rebuilt only when it is no longer maximal, and only the CPTs whose parents changed
+// are reallocated, the rest are refilled from the counts.
+bool BayesNet::update(const vector<Instance*>& batch) {
+    int numOfFeatures = metadata->numOfFeatures;
+    
+    pairwiseCounts->update(batch);
+    if (options.modelType == AVERAGED_ONE_DEPENDENCE)
+        return false;
+    
+    vector<vector<int> > oldBayesNet = bayesNet;
+    if (options.modelType == TREE_AUGMENTED) {
+        for (int a = 0; a < activeFeatures.size(); ++a) {
+            for (int b = a + 1; b < activeFeatures.size(); ++b) {
+                int i = activeFeatures[a];
+                int j = activeFeatures[b];
+                mutualInfoTable[i][j] = mutualInfoTable[j][i] = pairwiseCounts->computeRunningMutualInfo(i, j);
+            }
+        }
+        if (!isMaximalSpanningTree()) {
+            maximalSpanningTree.clear();
+            createMaximalSpanningTree();
+            bayesNet.clear();
+            createBayesNet();
+        }
+    }
+    
+    bool structureChanged = false;
+    for (int i = 0; i < probabilityTables.size(); ++i) {
+        if (!probabilityTables[i])
+            continue;
+        if (i < numOfFeatures && bayesNet[i] != oldBayesNet[i]) {
+            delete probabilityTables[i];
+            probabilityTables[i] = computeCPT(i, bayesNet[i], true);
+            structureChanged = true;
+        } else {
+            probabilityTables[i]->buildTable(*pairwiseCounts);
+        }
+    }
+    
+    if (options.earlyExit) {
+        for (int i = 0; i < numOfFeatures; ++i)
+            classMutualInfo[i] = pairwiseCounts->computeClassMutualInfo(i);
+        createScoringPlan();
+    }
+    
+    return structureChanged;
+}
+
+void BayesNet::getScoringFootprint(size_t& tableBytes, int& linesPerInstance) const {
+    int rangeY = metadata->classVariable->getRange();
+    
+    if (options.modelType == AVERAGED_ONE_DEPENDENCE) {
+        int numOfActive = (int)activeFeatures.size();
+        int linesPerCell = (int)((rangeY * sizeof(int) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES);
+        tableBytes = pairwiseCounts->getMemoryUsage();
+        linesPerInstance = (numOfActive + numOfActive * (numOfActive - 1) / 2) * linesPerCell;
+        return;
+    }
+    
+    int linesPerCell = (int)((rangeY * sizeof(double) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES);
+    tableBytes = 0;
+    linesPerInstance = 0;
+    for (int i = 0; i < probabilityTables.size(); ++i) {
+        if (probabilityTables[i]) {
+            tableBytes += probabilityTables[i]->getTableSize() * sizeof(double);
+            linesPerInstance += linesPerCell;
+        }
+    }
+}
+
 string BayesNet::predict(const Instance* instance, double* probability) const {
+    if (options.modelType == AVERAGED_ONE_DEPENDENCE)
+        return predictAveraged(instance, probability);
+    if (options.earlyExit && !probability)
+        return predictBounded(instance);
+    
     int numOfClasses = metadata->numOfClasses;
-    int numOfFeatures = metadata->numOfFeatures;
     
     Instance inst = *instance;
     double probSum = 0.0;
@@ -375,9 +937,85 @@ string BayesNet::predict(const Instance* instance, double* probability) const {
     for (int y = 0; y < numOfClasses; ++y) {
         inst.classLabel = y;
         probs[y] = probabilityTables.back()->computeCondProb(&inst);
-        for (int x = 0; x < numOfFeatures; ++x) {
-            probs[y] *= probabilityTables[x]->computeCondProb(&inst);
+        for (int k = 0; k < activeFeatures.size(); ++k) {
+            probs[y] *= probabilityTables[activeFeatures[k]]->computeCondProb(&inst);
+        }
+        probSum += probs[y];
+    }
+    
+    double maxProb = -1.0;
+    int maxClass = -1;
+    for (int y = 0; y < numOfClasses; ++y) {
+        probs[y] /= probSum;
+        if (probs[y] > maxProb) {
+            maxProb = probs[y];
+            maxClass = y;
+        }
+    }
+    
+    if (probability)
+        *probability = maxProb;
+    return metadata->classVariable->convertInternalToValue(maxClass);
+}
+
+// Every super-parent model P(y, xp) * prod_i P(xi | y, xp) is accumulated in log space in a
+// single sweep over the feature pairs: the counts of pair (i, j) feed both the model with
+// super-parent i and the one with super-parent j.
+string BayesNet::predictAveraged(const Instance* instance, double* probability) const {
+    int numOfClasses = metadata->numOfClasses;
+    int numOfFeatures = (int)activeFeatures.size();
+    int total = pairwiseCounts->getTotal();
+    
+    vector<int> vals(numOfFeatures);
+    vector<int> ranges(numOfFeatures);
+    for (int i = 0; i < numOfFeatures; ++i) {
+        vals[i] = (int)round(instance->featureVector[activeFeatures[i]]);
+        ranges[i] = metadata->featureList[activeFeatures[i]]->getRange();
+    }
+    
+    vector<double> logProbs(numOfFeatures * numOfClasses);
+    vector<bool> superParents(numOfFeatures);
+    int numOfSuperParents = 0;
+    for (int p = 0; p < numOfFeatures; ++p) {
+        int countXp = 0;
+        for (int y = 0; y < numOfClasses; ++y) {
+            int countXpY = pairwiseCounts->getFeatureCount(activeFeatures[p], vals[p], y);
+            countXp += countXpY;
+            logProbs[p * numOfClasses + y] = cachedLog(countXpY + 1) - log((double)total + numOfClasses * ranges[p]);
         }
+        superParents[p] = countXp >= AODE_MIN_FREQUENCY;
+        if (superParents[p])
+            numOfSuperParents++;
+    }
+    if (numOfSuperParents == 0)
+        superParents.assign(numOfFeatures, true);
+    
+    vector<int> buffer(numOfClasses);
+    for (int i = 0; i < numOfFeatures; ++i) {
+        int featureIdxI = activeFeatures[i];
+        for (int j = i + 1; j < numOfFeatures; ++j) {
+            int featureIdxJ = activeFeatures[j];
+            const int* counts = pairwiseCounts->getPairCounts(featureIdxI, featureIdxJ, vals[i], vals[j], &buffer[0]);
+            for (int y = 0; y < numOfClasses; ++y) {
+                double logCount = cachedLog(counts[y] + 1);
+                logProbs[i * numOfClasses + y] += logCount - cachedLog(pairwiseCounts->getFeatureCount(featureIdxI, vals[i], y) + ranges[j]);
+                logProbs[j * numOfClasses + y] += logCount - cachedLog(pairwiseCounts->getFeatureCount(featureIdxJ, vals[j], y) + ranges[i]);
+            }
+        }
+    }
+    
+    double maxLogProb = -INFINITY;
+    for (int p = 0; p < numOfFeatures; ++p)
+        if (superParents[p])
+            for (int y = 0; y < numOfClasses; ++y)
+                maxLogProb = max(maxLogProb, logProbs[p * numOfClasses + y]);
+    
+    double probSum = 0.0;
+    vector<double> probs(numOfClasses);
+    for (int y = 0; y < numOfClasses; ++y) {
+        for (int p = 0; p < numOfFeatures; ++p)
+            if (superParents[p])
+                probs[y] += exp(logProbs[p * numOfClasses + y] - maxLogProb);
         probSum += probs[y];
     }
     
@@ -394,4 +1032,48 @@ string BayesNet::predict(const Instance* instance, double* probability) const {
     if (probability)
         *probability = maxProb;
     return metadata->classVariable->convertInternalToValue(maxClass);
+}
+
+string BayesNet::predictBounded(const Instance* instance) const {
+    int numOfClasses = metadata->numOfClasses;
+    int numOfFeatures = metadata->numOfFeatures;
+    
+    vector<double> logProbs(scoringTables[numOfFeatures]);
+    for (int k = 0; k < scoringOrder.size(); ++k) {
+        int featureIdx = scoringOrder[k];
+        const CPT* cpt = probabilityTables[featureIdx];
+        const vector<double>& logTable = scoringTables[featureIdx];
+        if (logTable.empty()) {
+            Instance inst = *instance;
+            for (int y = 0; y < numOfClasses; ++y) {
+                inst.classLabel = y;
+                logProbs[y] += log(cpt->computeCondProb(&inst));
+            }
+        } else {
+            long long cell = (int)round(instance->featureVector[featureIdx]);
+            if (cpt->getParents().size() == 2) {
+                int parentIdx = cpt->getParents()[0];
+                cell = cell * metadata->featureList[parentIdx]->getRange() + (int)round(instance->featureVector[parentIdx]);
+            }
+            const double* logProbsX = &logTable[cell * numOfClasses];
+            for (int y = 0; y < numOfClasses; ++y)
+                logProbs[y] += logProbsX[y];
+        }
+        
+        double firstLogProb = -INFINITY;
+        double secondLogProb = -INFINITY;
+        for (int y = 0; y < numOfClasses; ++y) {
+            if (logProbs[y] > firstLogProb) {
+                secondLogProb = firstLogProb;
+                firstLogProb = logProbs[y];
+            } else if (logProbs[y] > secondLogProb) {
+                secondLogProb = logProbs[y];
+            }
+        }
+        if (firstLogProb - secondLogProb > scoringBounds[k + 1])
+            break;
+    }
+    
+    int maxClass = (int)(max_element(logProbs.begin(), logProbs.end()) - logProbs.begin());
+    return metadata->classVariable->convertInternalToValue(maxClass);
 }
\ No newline at end of file
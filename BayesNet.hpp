@@ -1,10 +1,45 @@
 #ifndef BayesNet_hpp
 #define BayesNet_hpp
 
+#include <cmath>
+
 #include "Dataset.hpp"
+#include "CountTensor.hpp"
 
 const char DELIMITER = ' ';
 const int PRECISION = 16;
+const int AODE_MIN_FREQUENCY = 1;
+const int LOG_CACHE_SIZE = 1 << 16;
+const double CMI_CONFIDENCE_Z = 2.576;
+
+enum ModelType {
+    NAIVE_BAYES,
+    TREE_AUGMENTED,
+    AVERAGED_ONE_DEPENDENCE
+};
+
+struct TrainingOptions {
+public:
+    ModelType modelType;
+    double minClassMutualInfo;
+    int maxFeatures;
+    bool earlyExit;
+    bool online;
+    // Upper bound in bytes on the pairwise counts held at once while building the TAN mutual
+    // information table; 0 means unlimited. Ignored for online training, which keeps all counts.
+    size_t memoryBudget;
+    // Initial number of rows on which the TAN mutual information is estimated before the sample is
+    // doubled; 0 estimates it on all rows. CPTs are always built on all rows.
+    int sampleSize;
+    
+    TrainingOptions(ModelType modelType = NAIVE_BAYES) :
+        modelType(modelType), minClassMutualInfo(0.0), maxFeatures(0), earlyExit(false), online(false), memoryBudget(0),
+        sampleSize(0) {}
+    
+    bool isPruning() const {
+        return minClassMutualInfo > 0.0 || maxFeatures > 0;
+    }
+};
 
 struct CPT {
 protected:
@@ -14,9 +49,24 @@ protected:
     CPT(int self, const vector<int>& parents) : self(self), parents(parents) {};
     
 public:
+    int getSelf() const {
+        return self;
+    }
+    
+    const vector<int>& getParents() const {
+        return parents;
+    }
+    
     virtual ~CPT() {};
     virtual void buildTable(const vector<Instance*>& instances) = 0;
+    virtual void buildTable(const CountTensor& counts) = 0;
     virtual double computeCondProb(const Instance* instance) const = 0;
+    virtual long long getTableSize() const = 0;
+    // Fills logTable with log Pr(self | parents) laid out as [(self * rangeParent0 + parent0) * rangeClass + class].
+    virtual void exportLogTable(vector<double>& logTable) const = 0;
+    // Upper bound, over all values of self and its non-class parents, of the largest difference
+    // in log Pr(self | parents) between two classes.
+    virtual double computeLogRatioBound() const = 0;
     virtual string toString() const = 0;
 };
 
@@ -31,7 +81,11 @@ public:
     }
     
     virtual void buildTable(const vector<Instance*>& instances);
+    virtual void buildTable(const CountTensor& counts);
     virtual double computeCondProb(const Instance* instance) const;
+    virtual long long getTableSize() const;
+    virtual void exportLogTable(vector<double>& logTable) const;
+    virtual double computeLogRatioBound() const;
     virtual string toString() const;
 };
 
@@ -50,7 +104,11 @@ public:
     }
     
     virtual void buildTable(const vector<Instance*>& instances);
+    virtual void buildTable(const CountTensor& counts);
     virtual double computeCondProb(const Instance* instance) const;
+    virtual long long getTableSize() const;
+    virtual void exportLogTable(vector<double>& logTable) const;
+    virtual double computeLogRatioBound() const;
     virtual string toString() const;
 };
 
@@ -73,7 +131,36 @@ public:
     }
     
     virtual void buildTable(const vector<Instance*>& instances);
+    virtual void buildTable(const CountTensor& counts);
+    virtual double computeCondProb(const Instance* instance) const;
+    virtual long long getTableSize() const;
+    virtual void exportLogTable(vector<double>& logTable) const;
+    virtual double computeLogRatioBound() const;
+    virtual string toString() const;
+};
+
+struct SparseCPT2 : public CPT {
+private:
+    int rangeX;
+    int rangeZ;
+    int rangeY;
+    vector<int> ZYOccurance;
+    SparseTable XZYOccurance;
+    
+public:
+    SparseCPT2(const DatasetMetadata* metadata, int self, const vector<int>& parents) : CPT(self, parents) {
+        rangeX = metadata->featureList[self]->getRange();
+        rangeZ = metadata->featureList[parents[0]]->getRange();
+        rangeY = metadata->classVariable->getRange();
+        ZYOccurance.resize(rangeZ * rangeY);
+    }
+    
+    virtual void buildTable(const vector<Instance*>& instances);
+    virtual void buildTable(const CountTensor& counts);
     virtual double computeCondProb(const Instance* instance) const;
+    virtual long long getTableSize() const;
+    virtual void exportLogTable(vector<double>& logTable) const;
+    virtual double computeLogRatioBound() const;
     virtual string toString() const;
 };
 
@@ -81,39 +168,105 @@ class BayesNet {
 private:
     const DatasetMetadata* metadata;
     const vector<Instance*>& instances;
-    bool treeAugmented;
+    TrainingOptions options;
     
+    CountTensor* pairwiseCounts;
+    bool ownsCounts;
+    bool tiled;
+    bool sampled;
+    int numOfSampledInstances;
+    vector<double> logCache;
+    vector<double> classMutualInfo;
+    vector<bool> featureMask;
+    vector<int> activeFeatures;
+    vector<int> scoringOrder;
+    vector<double> scoringBounds;
+    vector<vector<double> > scoringTables;
     vector<vector<double> > mutualInfoTable;
     vector<pair<int, int> > maximalSpanningTree;
     vector<vector<int> > bayesNet;
     vector<CPT*> probabilityTables;
     
-    double computeMutualInfo(int featureIdxI, int featureIdxJ) const;
-    CPT* computeCPT(int self, const vector<int>& parents) const;
+    CPT* computeCPT(int self, const vector<int>& parents, bool fromCounts = false) const;
+    
+    double cachedLog(int val) const {
+        return val < logCache.size() ? logCache[val] : log((double)val);
+    }
     
+    void createFeatureSelection();
+    bool isOverBudget() const;
     void createMutualInfoTable();
+    void createMutualInfoTile(int rowBegin, int rowEnd, int colBegin, int colEnd);
+    void createSampledMutualInfoTable();
+    bool isSeparated(const vector<vector<double> >& radius, vector<vector<bool> >& resolved) const;
     void createMaximalSpanningTree();
     void createBayesNet();
     void createProbabilityTables();
+    void createAveragedEstimators();
+    void createScoringPlan();
+    bool isMaximalSpanningTree() const;
+    
+    string predictAveraged(const Instance* instance, double* probability) const;
+    string predictBounded(const Instance* instance) const;
     
 public:
-    BayesNet(const DatasetMetadata* metadata, const vector<Instance*>& instances, bool treeAugmented);
+    BayesNet(const DatasetMetadata* metadata, const vector<Instance*>& instances, ModelType modelType) :
+        BayesNet(metadata, instances, TrainingOptions(modelType)) {}
+    // When sharedCounts is given, the model is trained from those counts (which must include the
+    // pairwise counts unless the model is naive Bayes) instead of counting the instances itself, so
+    // several models can be trained from one pass. The counts must outlive the model and cannot be
+    // combined with online training.
+    BayesNet(const DatasetMetadata* metadata, const vector<Instance*>& instances, const TrainingOptions& options,
+        CountTensor* sharedCounts = 0);
     
     ~BayesNet() {
         for (int i = 0; i < probabilityTables.size(); ++i)
             if (probabilityTables[i])
                 delete probabilityTables[i];
+        if (pairwiseCounts && ownsCounts)
+            delete pairwiseCounts;
     }
     
     const DatasetMetadata* getMetadata() const {
         return metadata;
     }
     
+    ModelType getModelType() const {
+        return options.modelType;
+    }
+    
+    const vector<bool>& getFeatureMask() const {
+        return featureMask;
+    }
+    
+    const vector<int>& getActiveFeatures() const {
+        return activeFeatures;
+    }
+    
+    // Number of rows the mutual information table was estimated on.
+    int getNumOfSampledInstances() const {
+        return numOfSampledInstances;
+    }
+    
+    const CPT* getProbabilityTable(int featureIdx) const {
+        return probabilityTables[featureIdx];
+    }
+    
+    string getFeatureSelection() const;
+    string getScoringPlan() const;
     string getMutualInfoTable() const;
     string getMaximalSpanningTree() const;
     string getBayesNet() const;
     string getProbabilityTables() const;
     
+    // Adds a batch of instances to a model trained with TrainingOptions::online. Returns whether the
+    // TAN structure changed.
+    bool update(const vector<Instance*>& batch);
+    
+    // Bytes of the tables read while scoring and the number of cache lines of them one prediction
+    // touches, assuming each lookup reads the contiguous per-class entries of one cell.
+    void getScoringFootprint(size_t& tableBytes, int& linesPerInstance) const;
+    
     string predict(const Instance* instance, double* probability = 0) const;
 };
 
@@ -0,0 +1,41 @@
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Blocking FIFO of at most capacity items connecting two pipeline stages; push() waits while
+// the queue is full and pop() while it is empty.
+template <typename T>
+class BoundedQueue {
+private:
+    size_t capacity;
+    deque<T> items;
+    mutex lock;
+    condition_variable notFull;
+    condition_variable notEmpty;
+    
+public:
+    BoundedQueue(size_t capacity) : capacity(capacity) {}
+    
+    void push(T item) {
+        unique_lock<mutex> guard(lock);
+        notFull.wait(guard, [this] { return items.size() < capacity; });
+        items.push_back(move(item));
+        notEmpty.notify_one();
+    }
+    
+    T pop() {
+        unique_lock<mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return !items.empty(); });
+        T item = move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+};
+
+#endif /* BoundedQueue_hpp */
@@ -0,0 +1,328 @@
+#include <cmath>
+#include <algorithm>
+
+#include "CountTensor.hpp"
+
+static inline double xlog2(double val) {
+    return val * log2(val);
+}
+
+CountTensor::CountTensor(const DatasetMetadata* metadata, const vector<Instance*>& instances,
+    int rowBegin, int rowEnd, int colBegin, int colEnd) :
+    metadata(metadata), numOfFeatures(metadata->numOfFeatures), rangeY(metadata->classVariable->getRange()), total(0),
+    rowBegin(rowBegin), rowEnd(rowEnd), colBegin(colBegin), colEnd(colEnd), tracking(false) {
+    classCounts.resize(rangeY);
+    featureCounts.resize(numOfFeatures);
+    for (int i = 0; i < numOfFeatures; ++i)
+        featureCounts[i].resize(metadata->featureList[i]->getRange() * rangeY);
+    
+    rowStarts.resize(max(rowEnd - rowBegin, 0) + 1);
+    for (int i = rowBegin; i < rowEnd; ++i)
+        rowStarts[i - rowBegin + 1] = rowStarts[i - rowBegin] + max(colEnd - max(i + 1, colBegin), 0);
+    
+    long long numOfPairs = rowStarts.back();
+    pairOffsets.resize(numOfPairs);
+    sparsePairIdx.resize(numOfPairs, -1);
+    long long size = 0;
+    long long bandSize = 0;
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        long long rowSize = size;
+        for (int j = max(i + 1, colBegin); j < colEnd; ++j) {
+            long long p = pairIndex(i, j);
+            long long cells = (long long)metadata->featureList[i]->getRange() * metadata->featureList[j]->getRange() * rangeY;
+            if (cells > SPARSE_TABLE_THRESHOLD) {
+                sparsePairIdx[p] = (int)sparsePairCounts.size();
+                sparsePairCounts.push_back(SparseTable());
+            } else {
+                pairOffsets[p] = size;
+                size += cells;
+            }
+        }
+        rowSize = (size - rowSize) * sizeof(int);
+        if (i > rowBegin && bandSize + rowSize > CACHE_TILE_BYTES) {
+            bandEnds.push_back(i);
+            bandSize = 0;
+        }
+        bandSize += rowSize;
+    }
+    if (rowEnd > rowBegin)
+        bandEnds.push_back(rowEnd);
+    pairCounts.resize(size);
+    
+    update(instances);
+}
+
+size_t CountTensor::estimatePairSize(const DatasetMetadata* metadata, int featureIdxI, int featureIdxJ, int numOfInstances) {
+    long long cells = (long long)metadata->featureList[featureIdxI]->getRange() *
+        metadata->featureList[featureIdxJ]->getRange() * metadata->classVariable->getRange();
+    size_t bookkeeping = sizeof(long long) + sizeof(int);
+    if (cells <= SPARSE_TABLE_THRESHOLD)
+        return bookkeeping + cells * sizeof(int);
+    long long entries = min(cells, (long long)numOfInstances);
+    long long capacity = SparseTable().getCapacity();
+    while (capacity < 2 * entries)
+        capacity <<= 1;
+    return bookkeeping + sizeof(SparseTable) + capacity * (sizeof(long long) + sizeof(int));
+}
+
+size_t CountTensor::estimateFixedSize(const DatasetMetadata* metadata) {
+    int numOfFeatures = metadata->numOfFeatures;
+    int rangeY = metadata->classVariable->getRange();
+    size_t size = rangeY * sizeof(int) + CACHE_TILE_BYTES / 4;
+    for (int i = 0; i < numOfFeatures; ++i)
+        size += metadata->featureList[i]->getRange() * rangeY * sizeof(int) + sizeof(vector<int>);
+    return size + (numOfFeatures + 1) * (sizeof(long long) + sizeof(int));
+}
+
+size_t CountTensor::getMemoryUsage() const {
+    size_t size = (classCounts.size() + pairCounts.size()) * sizeof(int);
+    for (int i = 0; i < featureCounts.size(); ++i)
+        size += featureCounts[i].size() * sizeof(int);
+    for (int i = 0; i < sparsePairCounts.size(); ++i)
+        size += sparsePairCounts[i].getMemoryUsage();
+    return size;
+}
+
+void CountTensor::update(const vector<Instance*>& instances) {
+    int stride = numOfFeatures + 2;
+    int chunkSize = (int)max((size_t)1, min((size_t)MAX_CHUNK_SIZE, CACHE_TILE_BYTES / 4 / (stride * sizeof(int))));
+    vector<int> chunk(chunkSize * stride);
+    
+    for (int start = 0; start < instances.size(); start += chunkSize) {
+        int end = min(start + chunkSize, (int)instances.size());
+        for (int n = start; n < end; ++n) {
+            Instance* inst = instances[n];
+            int* vals = &chunk[(n - start) * stride];
+            int valY = vals[numOfFeatures] = (int)round(inst->classLabel);
+            int weight = vals[numOfFeatures + 1] = inst->weight;
+            total += weight;
+            classCounts[valY] += weight;
+            for (int i = 0; i < numOfFeatures; ++i) {
+                vals[i] = (int)round(inst->featureVector[i]);
+                int& count = featureCounts[i][vals[i] * rangeY + valY];
+                if (tracking) {
+                    marginalTerms[i][valY] += (count + weight) * log2(count + weight + 1.0) - count * log2(count + 1.0);
+                    marginalLogTerms[i][valY] += log2(count + weight + 1.0) - log2(count + 1.0);
+                }
+                count += weight;
+            }
+        }
+        
+        int bandBegin = rowBegin;
+        for (int b = 0; b < bandEnds.size(); bandBegin = bandEnds[b++]) {
+            for (int n = start; n < end; ++n) {
+                const int* vals = &chunk[(n - start) * stride];
+                int valY = vals[numOfFeatures];
+                int weight = vals[numOfFeatures + 1];
+                for (int i = bandBegin; i < bandEnds[b]; ++i) {
+                    int firstJ = max(i + 1, colBegin);
+                    long long p = pairIndex(i, firstJ);
+                    for (int j = firstJ; j < colEnd; ++j, ++p) {
+                        long long cell = ((long long)vals[i] * metadata->featureList[j]->getRange() + vals[j]) * rangeY + valY;
+                        int count;
+                        if (sparsePairIdx[p] < 0)
+                            count = pairCounts[pairOffsets[p] + cell] += weight;
+                        else
+                            count = sparsePairCounts[sparsePairIdx[p]].increment(cell, weight);
+                        if (tracking)
+                            cellTerms[p * rangeY + valY] += xlog2(count + 1.0) - xlog2(count - weight + 1.0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CountTensor::trackMutualInfo() {
+    tracking = true;
+    
+    marginalTerms.assign(numOfFeatures, vector<double>(rangeY));
+    marginalLogTerms.assign(numOfFeatures, vector<double>(rangeY));
+    for (int i = 0; i < numOfFeatures; ++i) {
+        for (int k = 0; k < featureCounts[i].size(); ++k) {
+            int count = featureCounts[i][k];
+            marginalTerms[i][k % rangeY] += count * log2(count + 1.0);
+            marginalLogTerms[i][k % rangeY] += log2(count + 1.0);
+        }
+    }
+    
+    cellTerms.assign(pairOffsets.size() * rangeY, 0.0);
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        for (int j = max(i + 1, colBegin); j < colEnd; ++j) {
+            long long p = pairIndex(i, j);
+            if (sparsePairIdx[p] < 0) {
+                long long cells = (long long)metadata->featureList[i]->getRange() * metadata->featureList[j]->getRange() * rangeY;
+                for (long long cell = 0; cell < cells; ++cell)
+                    cellTerms[p * rangeY + cell % rangeY] += xlog2(pairCounts[pairOffsets[p] + cell] + 1.0);
+            } else {
+                const SparseTable& table = sparsePairCounts[sparsePairIdx[p]];
+                for (int slot = 0; slot < table.getCapacity(); ++slot)
+                    if (table.isOccupied(slot))
+                        cellTerms[p * rangeY + table.getKey(slot) % rangeY] += xlog2(table.getValue(slot) + 1.0);
+            }
+        }
+    }
+}
+
+const int* CountTensor::getPairCounts(int featureIdxI, int featureIdxJ, int valI, int valJ, int* buffer) const {
+    long long p = pairIndex(featureIdxI, featureIdxJ);
+    long long cell = ((long long)valI * metadata->featureList[featureIdxJ]->getRange() + valJ) * rangeY;
+    if (sparsePairIdx[p] < 0)
+        return &pairCounts[pairOffsets[p] + cell];
+    
+    const SparseTable& table = sparsePairCounts[sparsePairIdx[p]];
+    for (int valY = 0; valY < rangeY; ++valY)
+        buffer[valY] = table.get(cell + valY);
+    return buffer;
+}
+
+double CountTensor::computeMutualInfo(int featureIdxI, int featureIdxJ) const {
+    long long p = pairIndex(featureIdxI, featureIdxJ);
+    if (sparsePairIdx[p] >= 0)
+        return computeSparseMutualInfo(featureIdxI, featureIdxJ);
+    
+    int rangeXi = metadata->featureList[featureIdxI]->getRange();
+    int rangeXj = metadata->featureList[featureIdxJ]->getRange();
+    const vector<int>& YXiOccurance = featureCounts[featureIdxI];
+    const vector<int>& YXjOccurance = featureCounts[featureIdxJ];
+    const int* YXiXjOccurance = &pairCounts[pairOffsets[p]];
+    
+    double mutualInfo = 0.0;
+    for (int valY = 0; valY < rangeY; ++valY) {
+        for (int valXi = 0; valXi < rangeXi; ++valXi) {
+            for (int valXj = 0; valXj < rangeXj; ++valXj) {
+                int count = YXiXjOccurance[(valXi * rangeXj + valXj) * rangeY + valY];
+                double pXiXjY = (count + 1.0) /
+                    (total + rangeXi * rangeXj * rangeY);
+                double pXiXj_Y = (count + 1.0) /
+                    (classCounts[valY] + rangeXi * rangeXj);
+                double pXi_Y = (YXiOccurance[valXi * rangeY + valY] + 1.0) /
+                    (classCounts[valY] + rangeXi);
+                double pXj_Y = (YXjOccurance[valXj * rangeY + valY] + 1.0) /
+                    (classCounts[valY] + rangeXj);
+                mutualInfo += pXiXjY * log2(pXiXj_Y / (pXi_Y * pXj_Y));
+            }
+        }
+    }
+    
+    return mutualInfo;
+}
+
+// Sparse pairs only visit the observed cells; the unseen ones hold a negligible share of the
+// smoothed mass and are left out.
+double CountTensor::computeMutualInfoDeviation(int featureIdxI, int featureIdxJ) const {
+    long long p = pairIndex(featureIdxI, featureIdxJ);
+    int rangeXi = metadata->featureList[featureIdxI]->getRange();
+    int rangeXj = metadata->featureList[featureIdxJ]->getRange();
+    const vector<int>& YXiOccurance = featureCounts[featureIdxI];
+    const vector<int>& YXjOccurance = featureCounts[featureIdxJ];
+    double normalizer = total + (double)rangeXi * rangeXj * rangeY;
+    
+    double firstMoment = 0.0;
+    double secondMoment = 0.0;
+    auto addCell = [&](long long cell, int count) {
+        int valY = (int)(cell % rangeY);
+        int valXj = (int)(cell / rangeY % rangeXj);
+        int valXi = (int)(cell / rangeY / rangeXj);
+        double pXiXjY = (count + 1.0) / normalizer;
+        double pXiXj_Y = (count + 1.0) / (classCounts[valY] + rangeXi * rangeXj);
+        double pXi_Y = (YXiOccurance[valXi * rangeY + valY] + 1.0) / (classCounts[valY] + rangeXi);
+        double pXj_Y = (YXjOccurance[valXj * rangeY + valY] + 1.0) / (classCounts[valY] + rangeXj);
+        double term = log2(pXiXj_Y / (pXi_Y * pXj_Y));
+        firstMoment += pXiXjY * term;
+        secondMoment += pXiXjY * term * term;
+    };
+    
+    if (sparsePairIdx[p] < 0) {
+        long long cells = (long long)rangeXi * rangeXj * rangeY;
+        for (long long cell = 0; cell < cells; ++cell)
+            addCell(cell, pairCounts[pairOffsets[p] + cell]);
+    } else {
+        const SparseTable& table = sparsePairCounts[sparsePairIdx[p]];
+        for (int slot = 0; slot < table.getCapacity(); ++slot)
+            if (table.isOccupied(slot))
+                addCell(table.getKey(slot), table.getValue(slot));
+    }
+    
+    return sqrt(max(0.0, secondMoment - firstMoment * firstMoment));
+}
+
+// Uses the same Laplace-smoothed joint as the CPTs, with both marginals taken from it.
+double CountTensor::computeClassMutualInfo(int featureIdx) const {
+    int rangeX = metadata->featureList[featureIdx]->getRange();
+    const vector<int>& XYOccurance = featureCounts[featureIdx];
+    double normalizer = total + (double)rangeX * rangeY;
+    
+    vector<double> pY(rangeY);
+    for (int valY = 0; valY < rangeY; ++valY)
+        pY[valY] = (classCounts[valY] + rangeX) / normalizer;
+    
+    double mutualInfo = 0.0;
+    for (int valX = 0; valX < rangeX; ++valX) {
+        int countX = 0;
+        for (int valY = 0; valY < rangeY; ++valY)
+            countX += XYOccurance[valX * rangeY + valY];
+        double pX = (countX + rangeY) / normalizer;
+        for (int valY = 0; valY < rangeY; ++valY) {
+            double pXY = (XYOccurance[valX * rangeY + valY] + 1.0) / normalizer;
+            mutualInfo += pXY * log2(pXY / (pX * pY[valY]));
+        }
+    }
+    
+    return mutualInfo;
+}
+
+double CountTensor::computeRunningMutualInfo(int featureIdxI, int featureIdxJ) const {
+    long long p = pairIndex(featureIdxI, featureIdxJ);
+    int rangeXi = metadata->featureList[featureIdxI]->getRange();
+    int rangeXj = metadata->featureList[featureIdxJ]->getRange();
+    
+    double mutualInfo = 0.0;
+    for (int valY = 0; valY < rangeY; ++valY) {
+        double marginalTerm = marginalTerms[featureIdxI][valY] + rangeXj * marginalLogTerms[featureIdxI][valY] +
+            marginalTerms[featureIdxJ][valY] + rangeXi * marginalLogTerms[featureIdxJ][valY];
+        double countY = classCounts[valY];
+        double normalizerTerm = (countY + (double)rangeXi * rangeXj) *
+            (log2(countY + rangeXi) + log2(countY + rangeXj) - log2(countY + (double)rangeXi * rangeXj));
+        mutualInfo += cellTerms[p * rangeY + valY] - marginalTerm + normalizerTerm;
+    }
+    
+    return mutualInfo / (total + (double)rangeXi * rangeXj * rangeY);
+}
+
+// Unseen (y, xi, xj) cells all carry the Laplace count of 1 and contribute nothing to
+// sum((n + 1) * log2(n + 1)), so only the observed cells are visited; the marginal terms
+// collapse to sums over the per-class marginal counts.
+double CountTensor::computeSparseMutualInfo(int featureIdxI, int featureIdxJ) const {
+    int rangeXi = metadata->featureList[featureIdxI]->getRange();
+    int rangeXj = metadata->featureList[featureIdxJ]->getRange();
+    const SparseTable& YXiXjOccurance = sparsePairCounts[sparsePairIdx[pairIndex(featureIdxI, featureIdxJ)]];
+    
+    vector<double> cellTerm(rangeY);
+    for (int slot = 0; slot < YXiXjOccurance.getCapacity(); ++slot) {
+        if (YXiXjOccurance.isOccupied(slot)) {
+            int valY = (int)(YXiXjOccurance.getKey(slot) % rangeY);
+            double count = YXiXjOccurance.getValue(slot) + 1.0;
+            cellTerm[valY] += count * log2(count);
+        }
+    }
+    
+    double mutualInfo = 0.0;
+    for (int valY = 0; valY < rangeY; ++valY) {
+        double marginalTerm = 0.0;
+        for (int valXi = 0; valXi < rangeXi; ++valXi) {
+            int count = featureCounts[featureIdxI][valXi * rangeY + valY];
+            marginalTerm += (count + rangeXj) * log2(count + 1.0);
+        }
+        for (int valXj = 0; valXj < rangeXj; ++valXj) {
+            int count = featureCounts[featureIdxJ][valXj * rangeY + valY];
+            marginalTerm += (count + rangeXi) * log2(count + 1.0);
+        }
+        double countY = classCounts[valY];
+        double normalizerTerm = (countY + (double)rangeXi * rangeXj) *
+            (log2(countY + rangeXi) + log2(countY + rangeXj) - log2(countY + (double)rangeXi * rangeXj));
+        mutualInfo += cellTerm[valY] - marginalTerm + normalizerTerm;
+    }
+    
+    return mutualInfo / (total + (double)rangeXi * rangeXj * rangeY);
+}
\ No newline at end of file
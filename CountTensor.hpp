@@ -0,0 +1,107 @@
+#ifndef CountTensor_hpp
+#define CountTensor_hpp
+
+#include "Dataset.hpp"
+#include "SparseTable.hpp"
+
+const long long SPARSE_TABLE_THRESHOLD = 1 << 20;
+const size_t CACHE_TILE_BYTES = 256 * 1024;
+const int CACHE_LINE_BYTES = 64;
+const int MAX_CHUNK_SIZE = 256;
+
+// Class-conditional counts N(y), N(xi, y) and N(xi, xj, y) for every feature pair i < j,
+// gathered in a single pass over the instances (the pair counts are skipped when only the
+// marginals are requested). Pair cells are laid out as
+// [(xi * rangeXj + xj) * rangeY + y] so the counts of all classes for one (xi, xj) are
+// contiguous; pairs whose dense block would exceed SPARSE_TABLE_THRESHOLD are kept in
+// a SparseTable instead.
+//
+// A tensor may cover only the pairs (i, j) with i in [rowBegin, rowEnd), j in [colBegin, colEnd)
+// and i < j, so a table too large for memory can be processed tile by tile. Counting walks the
+// instances in small chunks and, within a chunk, the pair rows in bands whose dense blocks fit
+// in CACHE_TILE_BYTES, so each band of counters stays cache resident while the chunk is replayed.
+//
+// Once trackMutualInfo() is called, update() also maintains the running sums
+// sum((n + 1) * log2(n + 1)) per pair and class and sum(n * log2(n + 1)), sum(log2(n + 1))
+// per feature and class, from which computeRunningMutualInfo() evaluates the conditional
+// mutual information of a pair in O(rangeY) instead of O(rangeXi * rangeXj * rangeY).
+class CountTensor {
+private:
+    const DatasetMetadata* metadata;
+    int numOfFeatures;
+    int rangeY;
+    int total;
+    int rowBegin;
+    int rowEnd;
+    int colBegin;
+    int colEnd;
+    bool tracking;
+    
+    vector<int> classCounts;
+    vector<vector<int> > featureCounts;
+    vector<long long> rowStarts;
+    vector<int> bandEnds;
+    vector<long long> pairOffsets;
+    vector<int> pairCounts;
+    vector<int> sparsePairIdx;
+    vector<SparseTable> sparsePairCounts;
+    vector<double> cellTerms;
+    vector<vector<double> > marginalTerms;
+    vector<vector<double> > marginalLogTerms;
+    
+    long long pairIndex(int featureIdxI, int featureIdxJ) const {
+        return rowStarts[featureIdxI - rowBegin] + featureIdxJ - max(featureIdxI + 1, colBegin);
+    }
+    
+    double computeSparseMutualInfo(int featureIdxI, int featureIdxJ) const;
+    
+public:
+    CountTensor(const DatasetMetadata* metadata, const vector<Instance*>& instances, bool pairwise = true) :
+        CountTensor(metadata, instances, 0, pairwise ? metadata->numOfFeatures : 0, 0, metadata->numOfFeatures) {}
+    CountTensor(const DatasetMetadata* metadata, const vector<Instance*>& instances,
+        int rowBegin, int rowEnd, int colBegin, int colEnd);
+    
+    // Upper bound on the bytes taken by pair featureIdxI < featureIdxJ, its bookkeeping included.
+    // A sparse pair is assumed to hold one entry per instance (at most one per cell) in a table
+    // that has just grown, i.e. the next power of two of at least twice the entries.
+    static size_t estimatePairSize(const DatasetMetadata* metadata, int featureIdxI, int featureIdxJ, int numOfInstances);
+    // Upper bound on the bytes a tensor or tile takes regardless of its pairs: the marginal
+    // counts, the per-row bookkeeping and the chunk buffer used while counting.
+    static size_t estimateFixedSize(const DatasetMetadata* metadata);
+    
+    int getTotal() const {
+        return total;
+    }
+    
+    size_t getMemoryUsage() const;
+    
+    int getClassCount(int valY) const {
+        return classCounts[valY];
+    }
+    
+    int getFeatureCount(int featureIdx, int valX, int valY) const {
+        return featureCounts[featureIdx][valX * rangeY + valY];
+    }
+    
+    // Returns the counts of all classes for cell (valI, valJ) of pair featureIdxI < featureIdxJ,
+    // either pointing into the dense block or copied into buffer for sparse pairs.
+    const int* getPairCounts(int featureIdxI, int featureIdxJ, int valI, int valJ, int* buffer) const;
+    
+    // Returns the pair counts if the pair is stored sparsely, null otherwise.
+    const SparseTable* getSparsePairCounts(int featureIdxI, int featureIdxJ) const {
+        long long p = pairIndex(featureIdxI, featureIdxJ);
+        return sparsePairIdx[p] < 0 ? 0 : &sparsePairCounts[sparsePairIdx[p]];
+    }
+    
+    void update(const vector<Instance*>& instances);
+    void trackMutualInfo();
+    
+    double computeMutualInfo(int featureIdxI, int featureIdxJ) const;
+    double computeRunningMutualInfo(int featureIdxI, int featureIdxJ) const;
+    // Standard deviation of the pointwise term log2(Pr(xi, xj | y) / (Pr(xi | y) Pr(xj | y))) under
+    // the smoothed joint, i.e. the per-instance spread behind computeMutualInfo().
+    double computeMutualInfoDeviation(int featureIdxI, int featureIdxJ) const;
+    double computeClassMutualInfo(int featureIdx) const;
+};
+
+#endif /* CountTensor_hpp */
@@ -1,6 +1,10 @@
+#include <iostream>
 #include <sstream>
 #include <fstream>
+#include <cmath>
+#include <thread>
 #include <algorithm>
+#include <unordered_map>
 
 #include "Dataset.hpp"
 
@@ -13,7 +17,7 @@ static inline string toLower(const string& str) {
 static inline void removeComment(string& str) {
     size_t idx = str.find('%');
     if (idx != string::npos)
-        str = str.substr(0, idx);
+        str.resize(idx);
 }
 
 static vector<string> tokenize(const string& str) {
@@ -48,6 +52,39 @@ static vector<string> tokenize(const string& str) {
     return tokens;
 }
 
+// Same splitting as tokenize(), but records (start, length) spans into a reused vector instead
+// of allocating a string per token; used for data rows.
+static void tokenize(const string& str, vector<pair<int, int> >& spans) {
+    spans.clear();
+    int start = 0;
+    bool quote = false;
+    for (int i = 0; i < str.length(); ++i) {
+        if (quote) {
+            if (str[i] == '\'' || str[i] == '"') {
+                quote = false;
+                spans.push_back(pair<int, int>(start, i - start));
+                start = i + 1;
+            }
+        } else {
+            switch (str[i]) {
+                case '\'':
+                case '"':
+                    quote = true;
+                case ' ':
+                case ',':
+                case '{':
+                case '}':
+                    if (i - start > 0)
+                        spans.push_back(pair<int, int>(start, i - start));
+                    start = i + 1;
+                    break;
+            }
+        }
+    }
+    if (start != str.length())
+        spans.push_back(pair<int, int>(start, (int)str.length() - start));
+}
+
 static istream& safeGetline(istream& is, string& t)
 {
     t.clear();
@@ -74,7 +111,52 @@ static istream& safeGetline(istream& is, string& t)
     }
 }
 
+// Returns 0 if a decoded column holds a missing or undeclared value.
+static Instance* parseInstance(const DatasetMetadata* metadata, const string& line, const vector<pair<int, int> >& spans,
+    const vector<bool>& featureMask) {
+    int numOfFeatures = metadata->numOfFeatures;
+    Instance* inst = new Instance(numOfFeatures);
+    for (int i = 0; i < numOfFeatures; ++i) {
+        if (featureMask.empty() || featureMask[i]) {
+            double internal = metadata->featureList[i]->convertValueToInternal(line.data() + spans[i].first, spans[i].second);
+            if (metadata->featureList[i]->isMissing(internal)) {
+                delete inst;
+                return 0;
+            }
+            inst->featureVector[i] = internal;
+        }
+    }
+    const pair<int, int>& classSpan = spans[numOfFeatures];
+    double classInternal = metadata->classVariable->convertValueToInternal(line.data() + classSpan.first, classSpan.second);
+    if (metadata->classVariable->isMissing(classInternal)) {
+        delete inst;
+        return 0;
+    }
+    inst->classLabel = classInternal;
+    return inst;
+}
+
+static void reportMissingValue(const string& file, int lineNumber) {
+    cout << file << ":" << lineNumber << ": missing or undeclared value (missing values are not supported)" << endl;
+}
+
+struct InstanceHash {
+    size_t operator()(const Instance* inst) const {
+        return inst->hashFeatures() ^ hash<double>()(inst->classLabel);
+    }
+};
+
+struct InstanceEqual {
+    bool operator()(const Instance* a, const Instance* b) const {
+        return a->classLabel == b->classLabel && a->featureVector == b->featureVector;
+    }
+};
+
 Dataset* Dataset::loadDataset(string trainFile) {
+    return loadTrainSet(trainFile, false);
+}
+
+Dataset* Dataset::loadTrainSet(string trainFile, bool compress) {
     ifstream finTrain;
     finTrain.open(trainFile);
     if (!finTrain.is_open())
@@ -83,14 +165,18 @@ Dataset* Dataset::loadDataset(string trainFile) {
     Dataset* dataset = new Dataset;
     
     string line;
+    vector<pair<int, int> > spans;
+    unordered_map<const Instance*, Instance*, InstanceHash, InstanceEqual> rows;
     int numOfFeatures = 0;
     bool header = true;
+    int lineNumber = 0;
     while (!safeGetline(finTrain, line).eof()) {
+        lineNumber++;
         removeComment(line);
         if (line.empty())
             continue;
-        vector<string> tokens = tokenize(line);
         if (header) {
+            vector<string> tokens = tokenize(line);
             string lineType = toLower(tokens[0]);
             if (lineType == "@relation") {
                 dataset->metadata->name = tokens[1];
@@ -113,15 +199,25 @@ Dataset* Dataset::loadDataset(string trainFile) {
                 header = false;
                 dataset->metadata->numOfClasses = dataset->metadata->classVariable->getRange();
                 dataset->metadata->numOfFeatures = numOfFeatures;
+                compress = compress && !dataset->hasNumericFeatures();
             }
         } else {
-            Instance* inst = new Instance(numOfFeatures);
-            for (int i = 0; i < numOfFeatures; ++i) {
-                double internal = dataset->metadata->featureList[i]->convertValueToInternal(tokens[i]);
-                inst->featureVector[i] = internal;
+            tokenize(line, spans);
+            Instance* inst = parseInstance(dataset->metadata, line, spans, vector<bool>());
+            if (!inst) {
+                reportMissingValue(trainFile, lineNumber);
+                delete dataset;
+                return 0;
+            }
+            if (compress) {
+                unordered_map<const Instance*, Instance*, InstanceHash, InstanceEqual>::iterator it = rows.find(inst);
+                if (it != rows.end()) {
+                    it->second->weight += inst->weight;
+                    delete inst;
+                    continue;
+                }
+                rows[inst] = inst;
             }
-            double classInternal = dataset->metadata->classVariable->convertValueToInternal(tokens[numOfFeatures]);
-            inst->classLabel = classInternal;
             dataset->trainSet.push_back(inst);
         }
     }
@@ -136,39 +232,245 @@ Dataset* Dataset::loadDataset(string trainFile, string testFile) {
     if (!dataset)
         return 0;
     
+    if (!dataset->loadTestSet(testFile)) {
+        delete dataset;
+        return 0;
+    }
+    
+    return dataset;
+}
+
+// Columns cleared in featureMask are left undecoded (-1); an empty mask decodes every column.
+bool Dataset::loadTestSet(string testFile, const vector<bool>& featureMask) {
     ifstream finTest;
     finTest.open(testFile);
     if (!finTest.is_open())
-        return dataset;
+        return false;
     
     string line;
-    int numOfFeatures = dataset->metadata->numOfFeatures;
+    vector<pair<int, int> > spans;
     bool header = true;
+    int lineNumber = 0;
     while (!safeGetline(finTest, line).eof()) {
+        lineNumber++;
         removeComment(line);
         if (line.empty())
             continue;
-        vector<string> tokens = tokenize(line);
         if (header) {
+            vector<string> tokens = tokenize(line);
             string lineType = toLower(tokens[0]);
             if (lineType == "@data") {
                 header = false;
             }
         } else {
-            Instance* inst = new Instance(numOfFeatures);
-            for (int i = 0; i < numOfFeatures; ++i) {
-                double internal = dataset->metadata->featureList[i]->convertValueToInternal(tokens[i]);
-                inst->featureVector[i] = internal;
+            tokenize(line, spans);
+            Instance* inst = parseInstance(metadata, line, spans, featureMask);
+            if (!inst) {
+                reportMissingValue(testFile, lineNumber);
+                return false;
             }
-            double classInternal = dataset->metadata->classVariable->convertValueToInternal(tokens[numOfFeatures]);
-            inst->classLabel = classInternal;
-            dataset->testSet.push_back(inst);
+            testSet.push_back(inst);
         }
     }
     
     finTest.close();
     
-    return dataset;
+    return !header;
+}
+
+InstanceReader::InstanceReader(const DatasetMetadata* metadata, string file, const vector<bool>& featureMask) :
+    metadata(metadata), featureMask(featureMask), file(file), lineNumber(0), hasData(false), failed(false) {
+    fin.open(file);
+    
+    while (fin.is_open() && !safeGetline(fin, line).eof()) {
+        lineNumber++;
+        removeComment(line);
+        if (line.empty())
+            continue;
+        vector<string> tokens = tokenize(line);
+        if (toLower(tokens[0]) == "@data") {
+            hasData = true;
+            break;
+        }
+    }
+}
+
+int InstanceReader::readBatch(vector<Instance*>& batch, int maxSize) {
+    int numOfRead = 0;
+    while (isOpen() && !failed && numOfRead < maxSize && !safeGetline(fin, line).eof()) {
+        lineNumber++;
+        removeComment(line);
+        if (line.empty())
+            continue;
+        tokenize(line, spans);
+        Instance* inst = parseInstance(metadata, line, spans, featureMask);
+        if (!inst) {
+            reportMissingValue(file, lineNumber);
+            failed = true;
+            break;
+        }
+        batch.push_back(inst);
+        numOfRead++;
+    }
+    return numOfRead;
+}
+
+// Collapses identical encoded rows into one weighted instance each, in order of first
+// appearance. The returned instances are owned by the dataset.
+const vector<Instance*>& Dataset::compressInstances(const vector<Instance*>& instances) {
+    vector<Instance*> compressedSet;
+    unordered_map<const Instance*, Instance*, InstanceHash, InstanceEqual> rows;
+    for (int i = 0; i < instances.size(); ++i) {
+        unordered_map<const Instance*, Instance*, InstanceHash, InstanceEqual>::iterator it = rows.find(instances[i]);
+        if (it != rows.end()) {
+            it->second->weight += instances[i]->weight;
+        } else {
+            Instance* inst = new Instance(*instances[i]);
+            rows[inst] = inst;
+            compressedSet.push_back(inst);
+        }
+    }
+    
+    for (Instance* i : trainSet)
+        if (i) delete i;
+    trainSet.swap(compressedSet);
+    
+    return trainSet;
+}
+
+bool Dataset::hasNumericFeatures() const {
+    for (int i = 0; i < metadata->numOfFeatures; ++i)
+        if (metadata->featureList[i]->getType() == "numeric")
+            return true;
+    return false;
+}
+
+static double computeEntropy(const vector<int>& classCounts, int total) {
+    double entropy = 0.0;
+    for (int y = 0; y < classCounts.size(); ++y)
+        if (classCounts[y] > 0)
+            entropy -= (double)classCounts[y] / total * log2((double)classCounts[y] / total);
+    return entropy;
+}
+
+static int countClasses(const vector<int>& classCounts) {
+    int numOfClasses = 0;
+    for (int y = 0; y < classCounts.size(); ++y)
+        if (classCounts[y] > 0)
+            numOfClasses++;
+    return numOfClasses;
+}
+
+// Fayyad and Irani: picks the boundary between distinct values of rows[begin, end) that minimizes
+// the class entropy of the two halves, and recurses into both halves only if the information gain
+// passes the MDL criterion. rows is sorted by value.
+static void splitByMDL(const vector<pair<double, int> >& rows, int begin, int end, int rangeY, vector<double>& cutPoints) {
+    int total = end - begin;
+    vector<int> counts(rangeY);
+    for (int k = begin; k < end; ++k)
+        counts[rows[k].second]++;
+    
+    vector<int> leftCounts(rangeY);
+    vector<int> rightCounts(counts);
+    double bestEntropy = INFINITY;
+    int bestSplit = -1;
+    for (int k = begin + 1; k < end; ++k) {
+        leftCounts[rows[k - 1].second]++;
+        rightCounts[rows[k - 1].second]--;
+        if (rows[k - 1].first == rows[k].first)
+            continue;
+        int numOfLeft = k - begin;
+        double entropy = (numOfLeft * computeEntropy(leftCounts, numOfLeft) +
+            (total - numOfLeft) * computeEntropy(rightCounts, total - numOfLeft)) / total;
+        if (entropy < bestEntropy) {
+            bestEntropy = entropy;
+            bestSplit = k;
+        }
+    }
+    if (bestSplit < 0)
+        return;
+    
+    leftCounts.assign(rangeY, 0);
+    for (int k = begin; k < bestSplit; ++k)
+        leftCounts[rows[k].second]++;
+    for (int y = 0; y < rangeY; ++y)
+        rightCounts[y] = counts[y] - leftCounts[y];
+    int numOfLeft = bestSplit - begin;
+    double entropy = computeEntropy(counts, total);
+    double leftEntropy = computeEntropy(leftCounts, numOfLeft);
+    double rightEntropy = computeEntropy(rightCounts, total - numOfLeft);
+    double gain = entropy - bestEntropy;
+    double delta = log2(pow(3.0, countClasses(counts)) - 2) - (countClasses(counts) * entropy -
+        countClasses(leftCounts) * leftEntropy - countClasses(rightCounts) * rightEntropy);
+    if (gain <= (log2(total - 1.0) + delta) / total)
+        return;
+    
+    splitByMDL(rows, begin, bestSplit, rangeY, cutPoints);
+    cutPoints.push_back((rows[bestSplit - 1].first + rows[bestSplit].first) / 2);
+    splitByMDL(rows, bestSplit, end, rangeY, cutPoints);
+}
+
+// Cuts at the boundaries closest to every numOfRows / numOfBins rows, skipping boundaries that
+// would fall inside a run of equal values.
+static void splitByFrequency(const vector<pair<double, int> >& rows, int numOfBins, vector<double>& cutPoints) {
+    int numOfRows = (int)rows.size();
+    for (int b = 1; b < numOfBins; ++b) {
+        int k = (int)((long long)b * numOfRows / numOfBins);
+        while (k < numOfRows && k > 0 && rows[k - 1].first == rows[k].first)
+            k++;
+        if (k <= 0 || k >= numOfRows)
+            continue;
+        double cut = (rows[k - 1].first + rows[k].first) / 2;
+        if (cutPoints.empty() || cut > cutPoints.back())
+            cutPoints.push_back(cut);
+    }
+}
+
+// Each numeric feature is sorted once; features are spread over the hardware threads.
+void Dataset::discretize(const vector<Instance*>& instances, DiscretizationType type, int numOfBins) {
+    vector<NumericFeature*> numericFeatures;
+    for (int i = 0; i < metadata->numOfFeatures; ++i)
+        if (metadata->featureList[i]->getType() == "numeric")
+            numericFeatures.push_back(static_cast<NumericFeature*>(metadata->featureList[i]));
+    if (numericFeatures.empty())
+        return;
+    
+    int rangeY = metadata->classVariable->getRange();
+    auto discretizeFeatures = [&](int first, int stride) {
+        vector<pair<double, int> > rows;
+        for (int f = first; f < numericFeatures.size(); f += stride) {
+            int featureIdx = numericFeatures[f]->getIndex();
+            rows.clear();
+            for (int n = 0; n < instances.size(); ++n) {
+                double val = instances[n]->featureVector[featureIdx];
+                if (val == val)
+                    rows.push_back(pair<double, int>(val, (int)round(instances[n]->classLabel)));
+            }
+            sort(rows.begin(), rows.end());
+            
+            vector<double> cutPoints;
+            if (type == MDL)
+                splitByMDL(rows, 0, (int)rows.size(), rangeY, cutPoints);
+            else
+                splitByFrequency(rows, numOfBins, cutPoints);
+            numericFeatures[f]->setCutPoints(cutPoints);
+        }
+    };
+    
+    int numOfThreads = (int)min((size_t)max(thread::hardware_concurrency(), 1u), numericFeatures.size());
+    vector<thread> workers;
+    for (int t = 1; t < numOfThreads; ++t)
+        workers.push_back(thread(discretizeFeatures, t, numOfThreads));
+    discretizeFeatures(0, numOfThreads);
+    for (int t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    
+    for (int n = 0; n < trainSet.size(); ++n) {
+        for (int f = 0; f < numericFeatures.size(); ++f) {
+            double& val = trainSet[n]->featureVector[numericFeatures[f]->getIndex()];
+            val = numericFeatures[f]->findBin(val);
+        }
+    }
 }
 
 string Dataset::toString() const {
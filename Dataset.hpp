@@ -1,9 +1,18 @@
 #ifndef Dataset_hpp
 #define Dataset_hpp
 
+#include <fstream>
+
 #include "Feature.hpp"
 #include "Instance.hpp"
 
+const int DEFAULT_NUM_OF_BINS = 10;
+
+enum DiscretizationType {
+    EQUAL_FREQUENCY,
+    MDL
+};
+
 struct DatasetMetadata {
 public:
     string name;
@@ -33,8 +42,24 @@ private:
     }
 
 public:
+    // Missing values are not supported: the first row with a missing or undeclared value is
+    // reported and loading fails, as it does for a file that cannot be opened.
     static Dataset* loadDataset(string trainFile);
     static Dataset* loadDataset(string trainFile, string testFile);
+    // With compress set, identical rows are merged into one weighted instance as they are read,
+    // unless the schema has numeric features (their raw values rarely repeat before binning).
+    static Dataset* loadTrainSet(string trainFile, bool compress);
+    
+    // Fails if the file cannot be opened, has no @data section or has a row with a missing value.
+    bool loadTestSet(string testFile, const vector<bool>& featureMask = vector<bool>());
+    // Collapses identical rows of instances, a subset of the train set, into weighted instances
+    // that replace the whole train set; the original rows are freed.
+    const vector<Instance*>& compressInstances(const vector<Instance*>& instances);
+    
+    bool hasNumericFeatures() const;
+    // Learns cut points for every numeric feature from instances, then re-encodes the raw values
+    // of the whole train set as bin indices; test rows loaded afterwards are binned on decode.
+    void discretize(const vector<Instance*>& instances, DiscretizationType type, int numOfBins = DEFAULT_NUM_OF_BINS);
     
     const DatasetMetadata* getMetadata() const {
         return metadata;
@@ -60,4 +85,36 @@ public:
     string toString() const;
 };
 
+// Reads the data rows of an ARFF file a batch at a time, decoding them with the metadata of an
+// already loaded dataset, so files of any size can be processed in constant memory.
+class InstanceReader {
+private:
+    const DatasetMetadata* metadata;
+    vector<bool> featureMask;
+    ifstream fin;
+    string line;
+    vector<pair<int, int> > spans;
+    string file;
+    int lineNumber;
+    bool hasData;
+    bool failed;
+    
+public:
+    InstanceReader(const DatasetMetadata* metadata, string file, const vector<bool>& featureMask = vector<bool>());
+    
+    // Whether the file was opened and its @data section found.
+    bool isOpen() const {
+        return fin.is_open() && hasData;
+    }
+    
+    // Whether reading stopped at a row with a missing or undeclared value.
+    bool hasFailed() const {
+        return failed;
+    }
+    
+    // Appends up to maxSize instances, owned by the caller, to batch. Returns the number read,
+    // 0 at the end of the file or after a row with a missing value.
+    int readBatch(vector<Instance*>& batch, int maxSize);
+};
+
 #endif /* Dataset_hpp */
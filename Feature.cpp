@@ -1,5 +1,8 @@
 #include <sstream>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include "Feature.hpp"
 
@@ -19,20 +22,132 @@ string NominalFeature::toString() const {
 }
 
 double NumericFeature::convertValueToInternal(const string& str) const {
-    return stod(str);
+    return convertValueToInternal(str.data(), str.length());
+}
+
+double NumericFeature::convertValueToInternal(const char* str, size_t length) const {
+    char buffer[64];
+    size_t size = min(length, sizeof(buffer) - 1);
+    memcpy(buffer, str, size);
+    buffer[size] = '\0';
+    char* end = 0;
+    double val = strtod(buffer, &end);
+    if (end == buffer)
+        val = NAN;
+    return isDiscretized() ? findBin(val) : val;
 }
 
 double NominalFeature::convertValueToInternal(const string& str) const {
-    unordered_map<string, int>::const_iterator it = nameToIdx.find(str);
-    if (it != nameToIdx.end())
-        return it->second;
-    else
+    return convertValueToInternal(str.data(), str.length());
+}
+
+double NominalFeature::convertValueToInternal(const char* str, size_t length) const {
+    if (hashTable.empty()) {
+        for (int i = getRange() - 1; i >= 0; --i)
+            if (isEqual(i, str, length))
+                return i;
         return -1;
+    }
+    int idx = hashTable[findSlot(hashValue(str, length, hashSeed))];
+    return idx >= 0 && isEqual(idx, str, length) ? idx : -1;
+}
+
+// 64-bit FNV-1a with the seed folded into the offset basis, followed by a finalizer so that both
+// halves are usable: the high half picks the bucket and the whole value the probe.
+unsigned long long NominalFeature::hashValue(const char* str, size_t length, unsigned int seed) {
+    unsigned long long h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+    for (size_t i = 0; i < length; ++i)
+        h = (h ^ (unsigned char)str[i]) * 1099511628211ull;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull;
+    return h ^ (h >> 33);
+}
+
+// Places buckets in decreasing order of size, each at the first displacement whose slots are all
+// free; a single value always finds a slot, since the probe visits every slot. Only when a larger
+// bucket cannot be placed is the whole table rebuilt with the next seed. A value declared twice
+// lands in the same bucket as its earlier copy and replaces it there, so it decodes to its last
+// index.
+void NominalFeature::createPerfectHash() {
+    size_t numOfValues = getRange();
+    size_t numOfBuckets = 1;
+    while (numOfBuckets * PERFECT_HASH_BUCKET_SIZE < numOfValues)
+        numOfBuckets <<= 1;
+    size_t size = 1;
+    while (size < numOfValues + numOfValues / 4)
+        size <<= 1;
+    bucketMask = numOfBuckets - 1;
+    hashMask = size - 1;
     
+    vector<unsigned long long> hashes(numOfValues);
+    vector<vector<int> > buckets(numOfBuckets);
+    vector<size_t> order(numOfBuckets);
+    vector<size_t> slots;
+    for (unsigned int seed = 0; ; ++seed) {
+        hashSeed = seed;
+        for (size_t b = 0; b < numOfBuckets; ++b)
+            buckets[b].clear();
+        for (size_t i = 0; i < numOfValues; ++i) {
+            hashes[i] = hashValue(idxToName[i].data(), idxToName[i].length(), hashSeed);
+            vector<int>& bucket = buckets[(size_t)(hashes[i] >> 32) & bucketMask];
+            vector<int>::iterator it = bucket.begin();
+            while (it != bucket.end() && !(hashes[*it] == hashes[i] && idxToName[*it] == idxToName[i]))
+                ++it;
+            if (it != bucket.end())
+                *it = (int)i;
+            else
+                bucket.push_back((int)i);
+        }
+        for (size_t b = 0; b < numOfBuckets; ++b)
+            order[b] = b;
+        stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+        
+        hashTable.assign(size, -1);
+        displacements.assign(numOfBuckets, 0);
+        bool isPerfect = true;
+        for (size_t o = 0; o < numOfBuckets && isPerfect && !buckets[order[o]].empty(); ++o) {
+            const vector<int>& bucket = buckets[order[o]];
+            isPerfect = false;
+            for (unsigned int displacement = 0; displacement < size && !isPerfect; ++displacement) {
+                slots.clear();
+                isPerfect = true;
+                for (size_t k = 0; k < bucket.size() && isPerfect; ++k) {
+                    size_t slot = findSlot(hashes[bucket[k]], displacement);
+                    isPerfect = hashTable[slot] < 0 && find(slots.begin(), slots.end(), slot) == slots.end();
+                    slots.push_back(slot);
+                }
+                if (isPerfect) {
+                    displacements[order[o]] = displacement;
+                    for (size_t k = 0; k < bucket.size(); ++k)
+                        hashTable[slots[k]] = bucket[k];
+                }
+            }
+        }
+        if (isPerfect)
+            return;
+    }
 }
 
 string NumericFeature::convertInternalToValue(double val) const {
     stringstream ss;
+    if (isDiscretized()) {
+        int bin = (int)round(val);
+        if (bin < 0)
+            return "?";
+        ss << "(";
+        if (bin == 0)
+            ss << "-inf";
+        else
+            ss << cutPoints[bin - 1];
+        ss << "-";
+        if (bin == cutPoints.size())
+            ss << "inf";
+        else
+            ss << cutPoints[bin];
+        ss << "]";
+        return ss.str();
+    }
     ss.setf(ios::fixed, ios::floatfield);
     ss.precision(6);
     ss << val;
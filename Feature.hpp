@@ -3,10 +3,12 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
 
 using namespace std;
 
+const int SMALL_NOMINAL_RANGE = 4;
+const int PERFECT_HASH_BUCKET_SIZE = 4;
+
 class Feature {
 private:
     int index;
@@ -17,6 +19,10 @@ private:
 protected:
     Feature(int index, const string& name, const string& type, int range) : index(index), name(name), type(type), range(range) {}
     
+    void setRange(int range) {
+        this->range = range;
+    }
+    
 public:
     int getIndex() const {
         return index;
@@ -37,34 +43,112 @@ public:
     virtual ~Feature() {}
     virtual string toString() const = 0;
     virtual double convertValueToInternal(const string& str) const = 0;
+    // Decodes a value that is not null-terminated, e.g. a token inside a data row.
+    virtual double convertValueToInternal(const char* str, size_t length) const {
+        return convertValueToInternal(string(str, length));
+    }
     virtual string convertInternalToValue(double val) const = 0;
+    // Whether a decoded value stands for a missing or undeclared value, which no table can index.
+    virtual bool isMissing(double val) const = 0;
 };
 
+// Values are read as raw doubles (NaN when missing) until cut points are set; from then on a
+// value decodes to the index of its bin (cutPoints[k - 1], cutPoints[k]] and the range is the
+// number of bins.
 class NumericFeature : public Feature {
 private:
+    bool discretized;
+    vector<double> cutPoints;
     
 public:
-    NumericFeature(int index, const string& name) : Feature(index, name, "numeric", 2) {}
+    NumericFeature(int index, const string& name) : Feature(index, name, "numeric", 2), discretized(false) {}
+    
+    bool isDiscretized() const {
+        return discretized;
+    }
+    
+    const vector<double>& getCutPoints() const {
+        return cutPoints;
+    }
+    
+    void setCutPoints(const vector<double>& cutPoints) {
+        this->cutPoints = cutPoints;
+        discretized = true;
+        setRange((int)cutPoints.size() + 1);
+    }
+    
+    // Branch-free binary search for the number of cut points below val; -1 for a missing value.
+    int findBin(double val) const {
+        if (val != val)
+            return -1;
+        if (cutPoints.empty())
+            return 0;
+        const double* base = cutPoints.data();
+        size_t n = cutPoints.size();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half] < val ? base + half : base;
+            n -= half;
+        }
+        return (int)(base - cutPoints.data()) + (*base < val);
+    }
     
     virtual string toString() const;
     virtual double convertValueToInternal(const string& str) const;
+    virtual double convertValueToInternal(const char* str, size_t length) const;
     virtual string convertInternalToValue(double val) const;
+    
+    virtual bool isMissing(double val) const {
+        return discretized ? val < 0 : val != val;
+    }
 };
 
+// Values are decoded without allocating: features with at most SMALL_NOMINAL_RANGE values are
+// matched by comparing against each value in turn, larger ones through a perfect hash built when
+// the feature is created. The hash follows hash-and-displace: values are grouped into buckets of
+// about PERFECT_HASH_BUCKET_SIZE, and each bucket stores the displacement that moves all of its
+// values to free slots of a table of at most 2.5 slots per value, so a lookup is one hash, one
+// displacement, one probe and one compare.
 class NominalFeature : public Feature {
 private:
     vector<string> idxToName;
-    unordered_map<string, int> nameToIdx;
+    unsigned int hashSeed;
+    size_t hashMask;
+    size_t bucketMask;
+    vector<unsigned int> displacements;
+    vector<int> hashTable;
+    
+    static unsigned long long hashValue(const char* str, size_t length, unsigned int seed);
+    
+    size_t findSlot(unsigned long long h) const {
+        return findSlot(h, displacements[(size_t)(h >> 32) & bucketMask]);
+    }
+    
+    size_t findSlot(unsigned long long h, unsigned int displacement) const {
+        unsigned long long step = ((h * 0x9E3779B97F4A7C15ull) >> 31) | 1;
+        return (size_t)(h + displacement * step) & hashMask;
+    }
+    
+    void createPerfectHash();
+    
+    bool isEqual(int idx, const char* str, size_t length) const {
+        return idxToName[idx].length() == length && idxToName[idx].compare(0, length, str, length) == 0;
+    }
     
 public:
-    NominalFeature(int index, const string& name, const vector<string>& values) : Feature(index, name, "nominal", (int)values.size()), idxToName(values) {
-        for (int i = 0; i < getRange(); ++i)
-            nameToIdx[idxToName[i]] = i;
+    NominalFeature(int index, const string& name, const vector<string>& values) : Feature(index, name, "nominal", (int)values.size()), idxToName(values), hashSeed(0), hashMask(0), bucketMask(0) {
+        if (getRange() > SMALL_NOMINAL_RANGE)
+            createPerfectHash();
     }
     
     virtual string toString() const;
     virtual double convertValueToInternal(const string& str) const;
+    virtual double convertValueToInternal(const char* str, size_t length) const;
     virtual string convertInternalToValue(double val) const;
+    
+    virtual bool isMissing(double val) const {
+        return val < 0;
+    }
 };
 
 #endif /* Feature_hpp */
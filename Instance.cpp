@@ -1,8 +1,16 @@
 #include <sstream>
+#include <functional>
 
 #include "Instance.hpp"
 #include "Dataset.hpp"
 
+size_t Instance::hashFeatures() const {
+    size_t h = featureVector.size();
+    for (int i = 0; i < featureVector.size(); ++i)
+        h = (h ^ hash<double>()(featureVector[i])) * 0x100000001B3ULL;
+    return h;
+}
+
 string Instance::toString(const DatasetMetadata* metadata, bool labelOnly) const {
     if (labelOnly) {
         return metadata->classVariable->convertInternalToValue(classLabel);
@@ -12,8 +12,10 @@ struct Instance {
 public:
     vector<double> featureVector;
     double classLabel;
+    int weight;
     
-    Instance(int numOfFeatures) : featureVector(numOfFeatures, -1), classLabel(-1) {}
+    Instance(int numOfFeatures) : featureVector(numOfFeatures, -1), classLabel(-1), weight(1) {}
+    size_t hashFeatures() const;
     string toString(const DatasetMetadata* metadata, bool labelOnly = false) const;
 };
 
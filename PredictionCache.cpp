@@ -0,0 +1,21 @@
+#include "PredictionCache.hpp"
+
+bool PredictionCache::lookup(const Instance* instance, string& predicted, double& probability) {
+    const Entry& entry = entries[instance->hashFeatures() % entries.size()];
+    if (entry.valid && entry.featureVector == instance->featureVector) {
+        predicted = entry.predicted;
+        probability = entry.probability;
+        numOfHits++;
+        return true;
+    }
+    numOfMisses++;
+    return false;
+}
+
+void PredictionCache::insert(const Instance* instance, const string& predicted, double probability) {
+    Entry& entry = entries[instance->hashFeatures() % entries.size()];
+    entry.valid = true;
+    entry.featureVector = instance->featureVector;
+    entry.predicted = predicted;
+    entry.probability = probability;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef PredictionCache_hpp
+#define PredictionCache_hpp
+
+#include "Instance.hpp"
+
+// Bounded direct-mapped cache of predictions keyed by the encoded feature vector; a row
+// hashing to an occupied slot evicts the previous entry.
+class PredictionCache {
+private:
+    struct Entry {
+        bool valid;
+        vector<double> featureVector;
+        string predicted;
+        double probability;
+        
+        Entry() : valid(false), probability(0.0) {}
+    };
+    
+    vector<Entry> entries;
+    int numOfHits;
+    int numOfMisses;
+    
+public:
+    PredictionCache(int capacity) : entries(capacity > 0 ? capacity : 1), numOfHits(0), numOfMisses(0) {}
+    
+    int getNumOfHits() const {
+        return numOfHits;
+    }
+    
+    int getNumOfMisses() const {
+        return numOfMisses;
+    }
+    
+    bool lookup(const Instance* instance, string& predicted, double& probability);
+    void insert(const Instance* instance, const string& predicted, double probability);
+};
+
+#endif /* PredictionCache_hpp */
@@ -0,0 +1,151 @@
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include "QuantizedModel.hpp"
+
+QuantizedModel::QuantizedModel(const BayesNet& model, QuantizationType type) : metadata(model.getMetadata()), type(type) {
+    model.getProbabilityTable(metadata->numOfFeatures)->exportLogTable(classLogProbs);
+    
+    const vector<int>& activeFeatures = model.getActiveFeatures();
+    for (int k = 0; k < activeFeatures.size(); ++k) {
+        const CPT* cpt = model.getProbabilityTable(activeFeatures[k]);
+        int parent = cpt->getParents().size() == 2 ? cpt->getParents()[0] : -1;
+        features.push_back(activeFeatures[k]);
+        parents.push_back(parent);
+        parentRanges.push_back(parent >= 0 ? metadata->featureList[parent]->getRange() : 1);
+        
+        if (cpt->getTableSize() > SPARSE_TABLE_THRESHOLD) {
+            offsets.push_back(-1);
+            scales.push_back(0.0f);
+            fallbackTables.push_back(cpt);
+        } else {
+            vector<double> logTable;
+            cpt->exportLogTable(logTable);
+            offsets.push_back(type == FLOAT32 ? floatTables.size() : fixedTables.size());
+            fallbackTables.push_back(0);
+            appendTable(logTable);
+        }
+    }
+}
+
+void QuantizedModel::appendTable(const vector<double>& logTable) {
+    if (type == FLOAT32) {
+        scales.push_back(1.0f);
+        floatTables.insert(floatTables.end(), logTable.begin(), logTable.end());
+    } else {
+        double minLogProb = *min_element(logTable.begin(), logTable.end());
+        double scale = minLogProb < 0.0 ? -minLogProb / 32767 : 1.0;
+        scales.push_back((float)scale);
+        for (int i = 0; i < logTable.size(); ++i) {
+            long q = lround(logTable[i] / scale);
+            fixedTables.push_back((int16_t)max(-32767L, min(0L, q)));
+        }
+    }
+}
+
+void QuantizedModel::computeClassProbs(const Instance* instance, vector<double>& logProbs) const {
+    int numOfClasses = metadata->numOfClasses;
+    
+    logProbs = classLogProbs;
+    for (int k = 0; k < features.size(); ++k) {
+        if (fallbackTables[k]) {
+            Instance inst = *instance;
+            for (int y = 0; y < numOfClasses; ++y) {
+                inst.classLabel = y;
+                logProbs[y] += log(fallbackTables[k]->computeCondProb(&inst));
+            }
+            continue;
+        }
+        
+        int valX = (int)round(instance->featureVector[features[k]]);
+        int valZ = parents[k] >= 0 ? (int)round(instance->featureVector[parents[k]]) : 0;
+        long long cell = offsets[k] + ((long long)valX * parentRanges[k] + valZ) * numOfClasses;
+        if (type == FLOAT32) {
+            const float* table = &floatTables[cell];
+            for (int y = 0; y < numOfClasses; ++y)
+                logProbs[y] += table[y];
+        } else {
+            const int16_t* table = &fixedTables[cell];
+            float scale = scales[k];
+            for (int y = 0; y < numOfClasses; ++y)
+                logProbs[y] += table[y] * scale;
+        }
+    }
+    
+    double maxLogProb = *max_element(logProbs.begin(), logProbs.end());
+    double probSum = 0.0;
+    for (int y = 0; y < numOfClasses; ++y) {
+        logProbs[y] = exp(logProbs[y] - maxLogProb);
+        probSum += logProbs[y];
+    }
+    for (int y = 0; y < numOfClasses; ++y)
+        logProbs[y] /= probSum;
+}
+
+string QuantizedModel::predict(const Instance* instance, double* probability) const {
+    vector<double> probs;
+    computeClassProbs(instance, probs);
+    
+    double maxProb = -1.0;
+    int maxClass = -1;
+    for (int y = 0; y < probs.size(); ++y) {
+        if (probs[y] > maxProb) {
+            maxProb = probs[y];
+            maxClass = y;
+        }
+    }
+    
+    if (probability)
+        *probability = maxProb;
+    return metadata->classVariable->convertInternalToValue(maxClass);
+}
+
+string QuantizedModel::getAgreementReport(const BayesNet& model, const vector<Instance*>& instances) const {
+    int agreeCount = 0;
+    int fullCorrectCount = 0;
+    int quantizedCorrectCount = 0;
+    double maxProbDiff = 0.0;
+    vector<double> quantizedProbs;
+    for (int i = 0; i < instances.size(); ++i) {
+        double fullProb = 0.0;
+        double quantizedProb = 0.0;
+        string fullPredicted = model.predict(instances[i], &fullProb);
+        string quantizedPredicted = predict(instances[i], &quantizedProb);
+        string actual = instances[i]->toString(metadata, true);
+        
+        // Compare both models on the class the full-precision model picked, agreeing or not.
+        computeClassProbs(instances[i], quantizedProbs);
+        int fullClass = (int)metadata->classVariable->convertValueToInternal(fullPredicted);
+        maxProbDiff = max(maxProbDiff, fabs(fullProb - quantizedProbs[fullClass]));
+        
+        if (fullPredicted == quantizedPredicted)
+            agreeCount++;
+        if (fullPredicted == actual)
+            fullCorrectCount++;
+        if (quantizedPredicted == actual)
+            quantizedCorrectCount++;
+    }
+    
+    size_t numOfCells = classLogProbs.size();
+    int numOfFallbackTables = 0;
+    for (int k = 0; k < features.size(); ++k) {
+        if (fallbackTables[k])
+            numOfFallbackTables++;
+        else
+            numOfCells += (size_t)metadata->featureList[features[k]]->getRange() * parentRanges[k] * metadata->numOfClasses;
+    }
+    
+    stringstream ss;
+    ss << "<Quantization Report>" << endl;
+    ss << "Table format: " << (type == FLOAT32 ? "float32" : "fixed16") << endl;
+    ss << "Table size: " << getTableBytes() + classLogProbs.size() * sizeof(double) << " bytes (full precision: " <<
+        numOfCells * sizeof(double) << " bytes, " << numOfFallbackTables << " tables left at full precision)" << endl;
+    ss << "Agreement: " << agreeCount << " out of " << instances.size() << " instances" << endl;
+    ss << "Accuracy: " << fullCorrectCount << " full precision, " << quantizedCorrectCount << " quantized" << endl;
+    ss.setf(ios::fixed, ios::floatfield);
+    ss.precision(PRECISION);
+    ss << "Max probability difference: " << maxProbDiff << endl;
+    
+    return ss.str();
+}
\ No newline at end of file
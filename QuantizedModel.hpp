@@ -0,0 +1,46 @@
+#ifndef QuantizedModel_hpp
+#define QuantizedModel_hpp
+
+#include <cstdint>
+
+#include "BayesNet.hpp"
+
+enum QuantizationType {
+    FLOAT32,
+    FIXED16
+};
+
+// Low-precision copy of the log-probability tables of a naive Bayes or TAN model. FLOAT32
+// stores every log-probability as a float; FIXED16 stores it as an int16 multiple of a
+// per-table scale chosen so the smallest log-probability maps to -32767. Tables above
+// SPARSE_TABLE_THRESHOLD cells are not expanded and keep scoring through their CPT.
+class QuantizedModel {
+private:
+    const DatasetMetadata* metadata;
+    QuantizationType type;
+    
+    vector<int> features;
+    vector<int> parents;
+    vector<int> parentRanges;
+    vector<long long> offsets;
+    vector<float> scales;
+    vector<float> floatTables;
+    vector<int16_t> fixedTables;
+    vector<const CPT*> fallbackTables;
+    vector<double> classLogProbs;
+    
+    void appendTable(const vector<double>& logTable);
+    void computeClassProbs(const Instance* instance, vector<double>& probs) const;
+    
+public:
+    QuantizedModel(const BayesNet& model, QuantizationType type);
+    
+    size_t getTableBytes() const {
+        return floatTables.size() * sizeof(float) + fixedTables.size() * sizeof(int16_t);
+    }
+    
+    string predict(const Instance* instance, double* probability = 0) const;
+    string getAgreementReport(const BayesNet& model, const vector<Instance*>& instances) const;
+};
+
+#endif /* QuantizedModel_hpp */
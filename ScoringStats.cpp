@@ -0,0 +1,103 @@
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+#include "ScoringStats.hpp"
+
+LatencyHistogram::LatencyHistogram() : total(0), sum(0), maxLatency(0) {
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i)
+        counts[i].store(0, memory_order_relaxed);
+}
+
+int LatencyHistogram::bucketIndex(unsigned long long latency) {
+    if (latency < 16)
+        return (int)latency;
+    int exponent = 63 - __builtin_clzll(latency);
+    return 16 + (exponent - 4) * 8 + (int)((latency >> (exponent - 3)) & 7);
+}
+
+// Midpoint of the bucket.
+unsigned long long LatencyHistogram::bucketValue(int idx) {
+    if (idx < 16)
+        return idx;
+    int exponent = (idx - 16) / 8 + 4;
+    unsigned long long width = 1ULL << (exponent - 3);
+    return (1ULL << exponent) + ((idx - 16) % 8) * width + width / 2;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i)
+        addRelaxed(counts[i], other.counts[i].load(memory_order_relaxed));
+    addRelaxed(total, other.total.load(memory_order_relaxed));
+    addRelaxed(sum, other.sum.load(memory_order_relaxed));
+    maxLatency.store(max(maxLatency.load(memory_order_relaxed), other.maxLatency.load(memory_order_relaxed)), memory_order_relaxed);
+}
+
+unsigned long long LatencyHistogram::getPercentile(double quantile) const {
+    unsigned long long numOfRecords = total.load(memory_order_relaxed);
+    if (numOfRecords == 0)
+        return 0;
+    unsigned long long rank = (unsigned long long)ceil(quantile * numOfRecords);
+    unsigned long long seen = 0;
+    for (int i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+        seen += counts[i].load(memory_order_relaxed);
+        if (seen >= max(rank, 1ULL))
+            return min(bucketValue(i), maxLatency.load(memory_order_relaxed));
+    }
+    return maxLatency.load(memory_order_relaxed);
+}
+
+string LatencyHistogram::toJson() const {
+    unsigned long long numOfRecords = total.load(memory_order_relaxed);
+    stringstream ss;
+    ss << "{\"count\": " << numOfRecords <<
+        ", \"mean\": " << (numOfRecords ? sum.load(memory_order_relaxed) / numOfRecords : 0) <<
+        ", \"p50\": " << getPercentile(0.5) <<
+        ", \"p99\": " << getPercentile(0.99) <<
+        ", \"p999\": " << getPercentile(0.999) <<
+        ", \"max\": " << maxLatency.load(memory_order_relaxed) << "}";
+    return ss.str();
+}
+
+ScoringStats::ScoringStats(size_t tableBytes, int linesPerInstance) :
+    start(chrono::steady_clock::now()), tableBytes(tableBytes), linesPerInstance(linesPerInstance) {}
+
+ScoringStats::ThreadStats* ScoringStats::registerThread() {
+    lock_guard<mutex> guard(registryLock);
+    threads.push_back(unique_ptr<ThreadStats>(new ThreadStats));
+    return threads.back().get();
+}
+
+string ScoringStats::toJson() {
+    ThreadStats merged;
+    {
+        lock_guard<mutex> guard(registryLock);
+        for (int i = 0; i < threads.size(); ++i) {
+            merged.instanceLatency.merge(threads[i]->instanceLatency);
+            merged.batchLatency.merge(threads[i]->batchLatency);
+            addRelaxed(merged.cacheHits, threads[i]->cacheHits.load(memory_order_relaxed));
+            addRelaxed(merged.cacheMisses, threads[i]->cacheMisses.load(memory_order_relaxed));
+        }
+    }
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    unsigned long long numOfRows = merged.instanceLatency.getCount();
+    unsigned long long numOfHits = merged.cacheHits.load(memory_order_relaxed);
+    unsigned long long numOfScored = numOfRows - numOfHits;
+    double missShare = tableBytes > L2_CACHE_BYTES ? 1.0 - (double)L2_CACHE_BYTES / tableBytes : 0.0;
+    
+    stringstream ss;
+    ss << "{" << endl;
+    ss << "  \"rows\": " << numOfRows << "," << endl;
+    ss << "  \"elapsedSeconds\": " << elapsed << "," << endl;
+    ss << "  \"rowsPerSecond\": " << (elapsed > 0.0 ? numOfRows / elapsed : 0.0) << "," << endl;
+    ss << "  \"instanceLatencyNs\": " << merged.instanceLatency.toJson() << "," << endl;
+    ss << "  \"batchLatencyNs\": " << merged.batchLatency.toJson() << "," << endl;
+    ss << "  \"predictionCache\": {\"hits\": " << numOfHits <<
+        ", \"misses\": " << merged.cacheMisses.load(memory_order_relaxed) << "}," << endl;
+    ss << "  \"tableCache\": {\"tableBytes\": " << tableBytes << ", \"linesPerInstance\": " << linesPerInstance <<
+        ", \"estimatedMisses\": " << (unsigned long long)(numOfScored * linesPerInstance * missShare) << "}" << endl;
+    ss << "}" << endl;
+    
+    return ss.str();
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef ScoringStats_hpp
+#define ScoringStats_hpp
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include <vector>
+#include <string>
+
+using namespace std;
+
+const int NUM_LATENCY_BUCKETS = 16 + 60 * 8;
+const size_t L2_CACHE_BYTES = 1 << 20;
+
+// Increment for counters with a single writer: a relaxed load and store instead of a locked
+// read-modify-write.
+static inline void addRelaxed(atomic<unsigned long long>& counter, unsigned long long amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Log-linear histogram of latencies in nanoseconds: exact below 16 ns, then 8 buckets per power
+// of two, so any percentile is reported within 12.5%. Written by a single thread with relaxed
+// atomics, so other threads can read it at any time without locking.
+class LatencyHistogram {
+private:
+    atomic<unsigned long long> counts[NUM_LATENCY_BUCKETS];
+    atomic<unsigned long long> total;
+    atomic<unsigned long long> sum;
+    atomic<unsigned long long> maxLatency;
+    
+    static int bucketIndex(unsigned long long latency);
+    static unsigned long long bucketValue(int idx);
+    
+public:
+    LatencyHistogram();
+    
+    void record(unsigned long long latency) {
+        addRelaxed(counts[bucketIndex(latency)], 1);
+        addRelaxed(total, 1);
+        addRelaxed(sum, latency);
+        if (latency > maxLatency.load(memory_order_relaxed))
+            maxLatency.store(latency, memory_order_relaxed);
+    }
+    
+    unsigned long long getCount() const {
+        return total.load(memory_order_relaxed);
+    }
+    
+    void merge(const LatencyHistogram& other);
+    unsigned long long getPercentile(double quantile) const;
+    string toJson() const;
+};
+
+// Scoring counters for one run. Each scoring thread registers once and then records into its
+// own counters; toJson() merges all threads into a machine-readable summary with latency
+// percentiles, throughput, prediction cache hits and an estimate of the CPU cache misses on the
+// model tables (lines touched per scored row, scaled by the share of the tables that cannot stay
+// in L2).
+class ScoringStats {
+public:
+    struct ThreadStats {
+        LatencyHistogram instanceLatency;
+        LatencyHistogram batchLatency;
+        atomic<unsigned long long> cacheHits;
+        atomic<unsigned long long> cacheMisses;
+        
+        ThreadStats() : cacheHits(0), cacheMisses(0) {}
+        
+        void recordCacheLookup(bool isHit) {
+            addRelaxed(isHit ? cacheHits : cacheMisses, 1);
+        }
+    };
+    
+private:
+    mutex registryLock;
+    vector<unique_ptr<ThreadStats> > threads;
+    chrono::steady_clock::time_point start;
+    size_t tableBytes;
+    int linesPerInstance;
+    
+public:
+    ScoringStats(size_t tableBytes, int linesPerInstance);
+    
+    ThreadStats* registerThread();
+    string toJson();
+};
+
+#endif /* ScoringStats_hpp */
@@ -0,0 +1,57 @@
+#include "SparseTable.hpp"
+
+const long long SparseTable::EMPTY_KEY;
+
+static inline unsigned long long hashKey(long long key) {
+    unsigned long long h = (unsigned long long)key * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+int SparseTable::findSlot(long long key) const {
+    int slot = (int)(hashKey(key) & mask);
+    while (keys[slot] != EMPTY_KEY && keys[slot] != key)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void SparseTable::grow() {
+    vector<long long> oldKeys;
+    vector<int> oldValues;
+    oldKeys.swap(keys);
+    oldValues.swap(values);
+    
+    keys.assign(oldKeys.size() * 2, EMPTY_KEY);
+    values.assign(oldValues.size() * 2, 0);
+    mask = (int)keys.size() - 1;
+    
+    for (int i = 0; i < oldKeys.size(); ++i) {
+        if (oldKeys[i] != EMPTY_KEY) {
+            int slot = findSlot(oldKeys[i]);
+            keys[slot] = oldKeys[i];
+            values[slot] = oldValues[i];
+        }
+    }
+}
+
+int SparseTable::increment(long long key, int amount) {
+    int slot = findSlot(key);
+    if (keys[slot] == EMPTY_KEY) {
+        if ((size + 1) * 2 > keys.size()) {
+            grow();
+            slot = findSlot(key);
+        }
+        keys[slot] = key;
+        size++;
+    }
+    values[slot] += amount;
+    return values[slot];
+}
+
+int SparseTable::get(long long key) const {
+    int slot = findSlot(key);
+    return keys[slot] == EMPTY_KEY ? 0 : values[slot];
+}
+
+size_t SparseTable::getMemoryUsage() const {
+    return keys.size() * (sizeof(long long) + sizeof(int));
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef SparseTable_hpp
+#define SparseTable_hpp
+
+#include <vector>
+
+using namespace std;
+
+class SparseTable {
+private:
+    static const long long EMPTY_KEY = -1;
+    
+    vector<long long> keys;
+    vector<int> values;
+    int size;
+    int mask;
+    
+    int findSlot(long long key) const;
+    void grow();
+    
+public:
+    SparseTable() : keys(16, EMPTY_KEY), values(16), size(0), mask(15) {}
+    
+    int getSize() const {
+        return size;
+    }
+    
+    int getCapacity() const {
+        return (int)keys.size();
+    }
+    
+    bool isOccupied(int slot) const {
+        return keys[slot] != EMPTY_KEY;
+    }
+    
+    long long getKey(int slot) const {
+        return keys[slot];
+    }
+    
+    int getValue(int slot) const {
+        return values[slot];
+    }
+    
+    int increment(long long key, int amount = 1);
+    int get(long long key) const;
+    size_t getMemoryUsage() const;
+};
+
+#endif /* SparseTable_hpp */
@@ -4,20 +4,167 @@
 #include <chrono>
 #include <random>
 #include <algorithm>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <fstream>
+#include <csignal>
 
-#include "BayesNet.hpp"
+#include "QuantizedModel.hpp"
+#include "PredictionCache.hpp"
+#include "BoundedQueue.hpp"
+#include "ScoringStats.hpp"
+
+const int STREAM_BATCH_SIZE = 256;
+const int STREAM_QUEUE_CAPACITY = 4;
+
+struct Prediction {
+    string label;
+    double prob;
+};
+
+struct ScoredBatch {
+    string output;
+    int numOfInstances;
+    int correctCount;
+};
+
+static volatile sig_atomic_t statsRequested = 0;
+
+static void requestStats(int) {
+    statsRequested = 1;
+}
+
+static unsigned long long elapsedNanoseconds(chrono::steady_clock::time_point begin) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count();
+}
+
+static void writeStats(ScoringStats* scoringStats, const string& statsFile) {
+    ofstream fout(statsFile);
+    fout << scoringStats->toJson();
+}
+
+static void parseArguments(int argc, char* argv[], vector<string>& positional, map<string, string>& options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t idx = arg.find('=');
+        if (idx != string::npos)
+            options[arg.substr(0, idx)] = arg.substr(idx + 1);
+        else
+            positional.push_back(arg);
+    }
+}
+
+// Trains naive Bayes and TAN from one shared count tensor and scores both in a single pass over
+// the test set, printing their predictions side by side. Both models read the shared tensor as
+// built from the full training set, so online updates, early exit, sampling and memory budgets
+// do not apply here. Returns false if the test set cannot be loaded.
+static bool compareModels(Dataset* dataset, const vector<Instance*>& trainSet, const string& testSetFile,
+    TrainingOptions trainingOptions, bool debugOutput) {
+    const DatasetMetadata* metadata = dataset->getMetadata();
+    trainingOptions.online = false;
+    trainingOptions.earlyExit = false;
+    trainingOptions.sampleSize = 0;
+    trainingOptions.memoryBudget = 0;
+    
+    CountTensor sharedCounts(metadata, trainSet);
+    trainingOptions.modelType = NAIVE_BAYES;
+    BayesNet naiveBayes(metadata, trainSet, trainingOptions, &sharedCounts);
+    trainingOptions.modelType = TREE_AUGMENTED;
+    BayesNet treeAugmented(metadata, trainSet, trainingOptions, &sharedCounts);
+    if (!dataset->loadTestSet(testSetFile, treeAugmented.getFeatureMask()))
+        return false;
+    
+    if (debugOutput) {
+        if (trainingOptions.isPruning())
+            cout << treeAugmented.getFeatureSelection() << endl;
+        cout << treeAugmented.getMutualInfoTable() << endl;
+        cout << treeAugmented.getMaximalSpanningTree() << endl;
+        cout << naiveBayes.getProbabilityTables() << endl;
+        cout << treeAugmented.getProbabilityTables() << endl;
+    }
+    
+    cout << naiveBayes.getBayesNet() << endl;
+    cout << treeAugmented.getBayesNet() << endl;
+    
+    const vector<Instance*>& testSet = dataset->getTestSet();
+    int naiveCorrectCount = 0;
+    int treeCorrectCount = 0;
+    int disagreeCount = 0;
+    cout << "<Predictions for Test-set Instances>" << endl;
+    cout << "Naive" << DELIMITER << "TAN" << DELIMITER << "Actual" << DELIMITER << "Naive-Probability" << DELIMITER << "TAN-Probability" << endl;
+    cout.setf(ios::fixed, ios::floatfield);
+    cout.precision(PRECISION);
+    for (int i = 0; i < testSet.size(); ++i) {
+        Instance* inst = testSet[i];
+        double naiveProb = 0.0;
+        double treeProb = 0.0;
+        string naivePredicted = naiveBayes.predict(inst, &naiveProb);
+        string treePredicted = treeAugmented.predict(inst, &treeProb);
+        string actual = inst->toString(metadata, true);
+        
+        if (naivePredicted == actual)
+            naiveCorrectCount++;
+        if (treePredicted == actual)
+            treeCorrectCount++;
+        if (naivePredicted != treePredicted)
+            disagreeCount++;
+        
+        cout << naivePredicted << DELIMITER << treePredicted << DELIMITER << actual << DELIMITER << naiveProb << DELIMITER << treeProb << endl;
+    }
+    cout << naiveCorrectCount << " out of " << testSet.size() << " test instances were correctly classified by naive Bayes" << endl;
+    cout << treeCorrectCount << " out of " << testSet.size() << " test instances were correctly classified by TAN" << endl;
+    cout << disagreeCount << " out of " << testSet.size() << " test instances were classified differently by the two models" << endl;
+    return true;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        cout << "usage: ./bayes train-set-file test-set-file mode:n|t [size-of-train-set] [debug-output:f|t]" << endl;
+    vector<string> args;
+    map<string, string> options;
+    parseArguments(argc, argv, args, options);
+    
+    if (args.size() < 3) {
+        cout << "usage: ./bayes train-set-file test-set-file mode:n|t|a|b [size-of-train-set] [debug-output:f|t] [option=value ...]" << endl;
+        cout << "mode b trains naive Bayes and TAN from one counting pass and compares them side by side" << endl;
+        cout << "options: prune-threshold=<min I(X;Y)> prune-top-k=<number of features> quantize=f32|q16 (modes n|t) early-exit=t (modes n|t, labels only)" << endl;
+        cout << "         compress=t (merge duplicate training rows) cache-size=<number of cached predictions>" << endl;
+        cout << "         online-batch=<rows> (train on the first batch, then add the rest batch by batch)" << endl;
+        cout << "         memory-budget=<MB> (mode t, build the mutual information table in tiles of pairwise counts)" << endl;
+        cout << "         cmi-sample=<rows> (mode t, estimate the mutual information table on a growing random sample)" << endl;
+        cout << "         stream=t (modes n|t|a, parse, score and print the test set concurrently in batches instead of loading it)" << endl;
+        cout << "         discretize=mdl|ef bins=<number> (binning of numeric features, supervised MDL by default)" << endl;
+        cout << "         stats=<file> (modes n|t|a, write scoring latency percentiles and throughput as JSON at exit and on SIGUSR1)" << endl;
     } else {
-        string trainSetFile = argv[1];
-        string testSetFile = argv[2];
-        bool treeAugmented = argv[3][0] == 't' ? true : false;
-        int sizeOfTrainSet = argc >= 5 ? atoi(argv[4]) : 0;
-        bool debugOutput = argc >= 6 ? (argv[5][0] == 't' ? true : false) : false;
+        string trainSetFile = args[0];
+        string testSetFile = args[1];
+        ModelType modelType = NAIVE_BAYES;
+        if (args[2][0] == 't')
+            modelType = TREE_AUGMENTED;
+        else if (args[2][0] == 'a')
+            modelType = AVERAGED_ONE_DEPENDENCE;
+        int sizeOfTrainSet = args.size() >= 4 ? atoi(args[3].c_str()) : 0;
+        bool debugOutput = args.size() >= 5 ? (args[4][0] == 't' ? true : false) : false;
+        
+        TrainingOptions trainingOptions(modelType);
+        if (options.count("prune-threshold"))
+            trainingOptions.minClassMutualInfo = atof(options["prune-threshold"].c_str());
+        if (options.count("prune-top-k"))
+            trainingOptions.maxFeatures = atoi(options["prune-top-k"].c_str());
+        if (options.count("early-exit"))
+            trainingOptions.earlyExit = options["early-exit"][0] == 't';
+        int onlineBatchSize = options.count("online-batch") ? atoi(options["online-batch"].c_str()) : 0;
+        trainingOptions.online = onlineBatchSize > 0;
+        if (options.count("memory-budget"))
+            trainingOptions.memoryBudget = (size_t)(atof(options["memory-budget"].c_str()) * (1 << 20));
+        if (options.count("cmi-sample"))
+            trainingOptions.sampleSize = atoi(options["cmi-sample"].c_str());
         
-        shared_ptr<Dataset> dataset(Dataset::loadDataset(trainSetFile, testSetFile));
+        bool compress = options.count("compress") && options["compress"][0] == 't';
+        shared_ptr<Dataset> dataset(Dataset::loadTrainSet(trainSetFile, compress && sizeOfTrainSet <= 0));
+        if (!dataset) {
+            cout << "cannot load the train set " << trainSetFile << endl;
+            return 1;
+        }
         const DatasetMetadata* metadata = dataset->getMetadata();
         
         vector<Instance*> trainSet(dataset->getTrainSet().begin(), dataset->getTrainSet().end());
@@ -26,10 +173,56 @@ int main(int argc, char* argv[]) {
             shuffle (trainSet.begin(), trainSet.end(), default_random_engine(seed));
             trainSet.resize(sizeOfTrainSet);
         }
+        if (dataset->hasNumericFeatures()) {
+            DiscretizationType discretizationType = options.count("discretize") && options["discretize"] == "ef" ? EQUAL_FREQUENCY : MDL;
+            int numOfBins = options.count("bins") ? atoi(options["bins"].c_str()) : DEFAULT_NUM_OF_BINS;
+            dataset->discretize(trainSet, discretizationType, numOfBins);
+        }
+        if (compress && (sizeOfTrainSet > 0 || dataset->hasNumericFeatures()))
+            trainSet = dataset->compressInstances(trainSet);
         
-        BayesNet bayesNet(metadata, trainSet, treeAugmented);
+        if (args[2][0] == 'b') {
+            const char* ignoredOptions[] = {"quantize", "early-exit", "cache-size", "online-batch", "memory-budget", "cmi-sample",
+                "stream", "stats"};
+            string ignored;
+            for (const char* option : ignoredOptions)
+                if (options.count(option))
+                    ignored += (ignored.empty() ? "" : " ") + string(option) + "=";
+            if (!ignored.empty())
+                cout << ignored << " not supported in mode b and ignored" << endl << endl;
+            if (!compareModels(dataset.get(), trainSet, testSetFile, trainingOptions, debugOutput)) {
+                cout << "cannot load the test set " << testSetFile << endl;
+                return 1;
+            }
+            return 0;
+        }
+        
+        int sizeOfInitialSet = trainingOptions.online ? min(onlineBatchSize, (int)trainSet.size()) : (int)trainSet.size();
+        vector<Instance*> initialSet(trainSet.begin(), trainSet.begin() + sizeOfInitialSet);
+        BayesNet bayesNet(metadata, initialSet, trainingOptions);
+        
+        int numOfUpdates = 0;
+        int numOfStructureChanges = 0;
+        for (int start = sizeOfInitialSet; start < trainSet.size(); start += onlineBatchSize) {
+            vector<Instance*> batch(trainSet.begin() + start, trainSet.begin() + min(start + onlineBatchSize, (int)trainSet.size()));
+            if (bayesNet.update(batch))
+                numOfStructureChanges++;
+            numOfUpdates++;
+        }
+        bool streaming = options.count("stream") && options["stream"][0] == 't';
+        shared_ptr<InstanceReader> reader;
+        if (streaming)
+            reader.reset(new InstanceReader(metadata, testSetFile, bayesNet.getFeatureMask()));
+        if (streaming ? !reader->isOpen() : !dataset->loadTestSet(testSetFile, bayesNet.getFeatureMask())) {
+            cout << "cannot load the test set " << testSetFile << endl;
+            return 1;
+        }
         
         if (debugOutput) {
+            if (trainingOptions.isPruning())
+                cout << bayesNet.getFeatureSelection() << endl;
+            if (trainingOptions.earlyExit)
+                cout << bayesNet.getScoringPlan() << endl;
             cout << bayesNet.getMutualInfoTable() << endl;
             cout << bayesNet.getMaximalSpanningTree() << endl;
             cout << bayesNet.getProbabilityTables() << endl;
@@ -37,23 +230,162 @@ int main(int argc, char* argv[]) {
         
         cout << bayesNet.getBayesNet() << endl;
         
+        if (trainingOptions.online)
+            cout << numOfStructureChanges << " out of " << numOfUpdates << " online updates changed the network structure" << endl << endl;
+        if (trainingOptions.sampleSize > 0 && modelType == TREE_AUGMENTED)
+            cout << "Mutual information estimated on " << bayesNet.getNumOfSampledInstances() << " out of " <<
+                initialSet.size() << " training instances" << endl << endl;
+        
+        shared_ptr<QuantizedModel> quantizedModel;
+        if (options.count("quantize") && modelType != AVERAGED_ONE_DEPENDENCE)
+            quantizedModel.reset(new QuantizedModel(bayesNet, options["quantize"] == "q16" ? FIXED16 : FLOAT32));
+        
+        bool labelsOnly = trainingOptions.earlyExit && !quantizedModel && modelType != AVERAGED_ONE_DEPENDENCE;
+        
+        shared_ptr<PredictionCache> predictionCache;
+        if (options.count("cache-size"))
+            predictionCache.reset(new PredictionCache(atoi(options["cache-size"].c_str())));
+        
+        shared_ptr<ScoringStats> scoringStats;
+        string statsFile = options.count("stats") ? options["stats"] : "";
+        if (!statsFile.empty()) {
+            size_t tableBytes = 0;
+            int linesPerInstance = 0;
+            bayesNet.getScoringFootprint(tableBytes, linesPerInstance);
+            if (quantizedModel)
+                tableBytes = quantizedModel->getTableBytes();
+            scoringStats.reset(new ScoringStats(tableBytes, linesPerInstance));
+            signal(SIGUSR1, requestStats);
+        }
+        auto checkStatsRequest = [&]() {
+            if (scoringStats && statsRequested) {
+                statsRequested = 0;
+                writeStats(scoringStats.get(), statsFile);
+            }
+        };
+        
         const vector<Instance*>& testSet = dataset->getTestSet();
+        int numOfTestInstances = 0;
         int correctCount = 0;
         cout << "<Predictions for Test-set Instances>" << endl;
-        cout << "Predicted" << DELIMITER << "Actual" << DELIMITER << "Probability" << endl;
+        if (labelsOnly)
+            cout << "Predicted" << DELIMITER << "Actual" << endl;
+        else
+            cout << "Predicted" << DELIMITER << "Actual" << DELIMITER << "Probability" << endl;
         cout.setf(ios::fixed, ios::floatfield);
         cout.precision(PRECISION);
-        for (int i = 0; i < testSet.size(); ++i) {
-            Instance* inst = testSet[i];
-            double prob = 0.0;
-            string predicted = bayesNet.predict(inst, &prob);
+        // Latencies cover the cache lookup and the model only; batches are scored into a vector of
+        // predictions first and formatted after the timer stops.
+        auto scoreBatch = [&](const vector<Instance*>& batch, int start, int end, vector<Prediction>& predictions,
+            ScoringStats::ThreadStats* threadStats) {
+            chrono::steady_clock::time_point batchBegin;
+            if (threadStats)
+                batchBegin = chrono::steady_clock::now();
+            predictions.resize(end - start);
+            for (int i = start; i < end; ++i) {
+                chrono::steady_clock::time_point begin;
+                if (threadStats)
+                    begin = chrono::steady_clock::now();
+                Prediction& prediction = predictions[i - start];
+                prediction.prob = 0.0;
+                bool isHit = predictionCache && predictionCache->lookup(batch[i], prediction.label, prediction.prob);
+                if (!isHit) {
+                    prediction.label = quantizedModel ? quantizedModel->predict(batch[i], &prediction.prob) :
+                        bayesNet.predict(batch[i], labelsOnly ? 0 : &prediction.prob);
+                    if (predictionCache)
+                        predictionCache->insert(batch[i], prediction.label, prediction.prob);
+                }
+                if (threadStats) {
+                    threadStats->instanceLatency.record(elapsedNanoseconds(begin));
+                    if (predictionCache)
+                        threadStats->recordCacheLookup(isHit);
+                }
+            }
+            if (threadStats && end > start)
+                threadStats->batchLatency.record(elapsedNanoseconds(batchBegin));
+        };
+        auto writePrediction = [&](const Instance* inst, const Prediction& prediction, ostream& out) -> bool {
             string actual = inst->toString(metadata, true);
             
-            if (predicted == actual)
-                correctCount++;
-            
-            cout << predicted << DELIMITER << actual << DELIMITER << prob << endl;
+            if (labelsOnly)
+                out << prediction.label << DELIMITER << actual << endl;
+            else
+                out << prediction.label << DELIMITER << actual << DELIMITER << prediction.prob << endl;
+            return prediction.label == actual;
+        };
+        
+        if (streaming) {
+            // Parser, scorer and the printing main thread overlap; at most STREAM_QUEUE_CAPACITY
+            // batches wait between two stages, and an empty batch marks the end of the file.
+            BoundedQueue<vector<Instance*> > parsedQueue(STREAM_QUEUE_CAPACITY);
+            BoundedQueue<ScoredBatch> scoredQueue(STREAM_QUEUE_CAPACITY);
+            thread parser([&]() {
+                while (true) {
+                    vector<Instance*> batch;
+                    bool isLast = reader->readBatch(batch, STREAM_BATCH_SIZE) == 0;
+                    parsedQueue.push(move(batch));
+                    if (isLast)
+                        break;
+                }
+            });
+            thread scorer([&]() {
+                ScoringStats::ThreadStats* threadStats = scoringStats ? scoringStats->registerThread() : 0;
+                vector<Prediction> predictions;
+                while (true) {
+                    vector<Instance*> batch = parsedQueue.pop();
+                    scoreBatch(batch, 0, (int)batch.size(), predictions, threadStats);
+                    stringstream out;
+                    out.setf(ios::fixed, ios::floatfield);
+                    out.precision(PRECISION);
+                    ScoredBatch scored = {"", (int)batch.size(), 0};
+                    for (int i = 0; i < batch.size(); ++i) {
+                        if (writePrediction(batch[i], predictions[i], out))
+                            scored.correctCount++;
+                        delete batch[i];
+                    }
+                    scored.output = out.str();
+                    scoredQueue.push(move(scored));
+                    if (batch.empty())
+                        break;
+                }
+            });
+            while (true) {
+                ScoredBatch scored = scoredQueue.pop();
+                if (scored.numOfInstances == 0)
+                    break;
+                cout << scored.output << flush;
+                numOfTestInstances += scored.numOfInstances;
+                correctCount += scored.correctCount;
+                checkStatsRequest();
+            }
+            parser.join();
+            scorer.join();
+            if (reader->hasFailed()) {
+                cout << "cannot load the test set " << testSetFile << endl;
+                return 1;
+            }
+        } else {
+            ScoringStats::ThreadStats* threadStats = scoringStats ? scoringStats->registerThread() : 0;
+            vector<Prediction> predictions;
+            for (int start = 0; start < testSet.size(); start += STREAM_BATCH_SIZE) {
+                int end = min(start + STREAM_BATCH_SIZE, (int)testSet.size());
+                scoreBatch(testSet, start, end, predictions, threadStats);
+                for (int i = start; i < end; ++i)
+                    if (writePrediction(testSet[i], predictions[i - start], cout))
+                        correctCount++;
+                checkStatsRequest();
+            }
+            numOfTestInstances = (int)testSet.size();
         }
-        cout << correctCount << " out of " << testSet.size() << " test instances were correctly classified" << endl;
+        cout << correctCount << " out of " << numOfTestInstances << " test instances were correctly classified" << endl;
+        
+        if (predictionCache)
+            cout << predictionCache->getNumOfHits() << " out of " << numOfTestInstances << " predictions were served from the cache" << endl;
+        
+        if (quantizedModel && !streaming)
+            cout << endl << quantizedModel->getAgreementReport(bayesNet, testSet);
+        
+        if (scoringStats)
+            writeStats(scoringStats.get(), statsFile);
     }
 }
\ No newline at end of file